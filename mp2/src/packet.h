@@ -2,6 +2,7 @@
 #ifndef PACKET_H
 #define PACKET_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define MSS 1400  // Maximum Segment Size
@@ -13,4 +14,35 @@ struct Packet {
     bool fin;        // 1 byte
     uint32_t len;    // 4 bytes
 };
+
+// Bytes of a Packet from fin on, so a packet can be sent from separate pieces with the same layout
+struct PacketTrailer {
+    bool fin;
+    uint32_t len;
+};
+static_assert(sizeof(Packet) - offsetof(Packet, fin) == sizeof(PacketTrailer) &&
+                  offsetof(Packet, len) - offsetof(Packet, fin) == offsetof(PacketTrailer, len),
+              "PacketTrailer must match the end of Packet");
+
+#define MAX_SACK_BLOCKS 4  // Ranges of packets held out of order that one ACK can carry
+
+// Data packets start to end - 1, held by the receiver after a gap
+struct SackBlock {
+    uint64_t start;
+    uint64_t end;
+};
+
+/*
+ * The ACK sent for every packet received. It is cumulative, every data packet
+ * before cumulative has been received, and it lists the first ranges received
+ * after it, lowest first, so the sender knows which packets are missing. Only the
+ * num_blocks blocks used are sent.
+ */
+struct AckHeader {
+    uint64_t cumulative;   // Next data packet the receiver waits for
+    uint32_t num_blocks;
+    uint32_t fin;          // Whether this ACKs the FIN packet
+    SackBlock blocks[MAX_SACK_BLOCKS];
+};
+#define ACK_HEADER_BYTES offsetof(AckHeader, blocks)
 #endif
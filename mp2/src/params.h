@@ -4,5 +4,12 @@
 
 #define TIMEOUT 21000  // Timeout in microseconds
 #define TIMEOUT_CWND_DEFAULT 64
+#define BATCH_SIZE 64  // Datagrams sent or received by one sendmmsg/recvmmsg
+
+#define REORDER_PACKETS 8192           // Packets the receiver holds ahead of the next one to write
+#define WRITE_BUFFER_BYTES (1 << 20)   // Bytes the receiver collects before writing them out
+#define WRITE_ALIGNMENT 4096           // Alignment of the write buffer, and of every write with --direct
+#define SOCKET_BUFFER_BYTES (4 << 20)  // Receive buffer asked for the receiver socket, capped by net.core.rmem_max
+#define SEND_WINDOW_PACKETS REORDER_PACKETS  // Packets the sender has in flight at most, a multiple of 64
 
 #endif
@@ -6,6 +6,8 @@
  */
 
  #include <arpa/inet.h>
+ #include <errno.h>
+ #include <fcntl.h>
  #include <netinet/in.h>
  #include <pthread.h>
  #include <stdio.h>
@@ -15,50 +17,93 @@
  #include <sys/types.h>
  #include <unistd.h>
  
+ #include <algorithm>
+ #include <cinttypes>
  #include <map>
+ #include <vector>
  
  #include "packet.h"
  #include "params.h"
  
- #define DEBUG 1
+ // #define DEBUG 1  // Logs every packet, one stdout write each on a terminal
  
  using namespace std;
  
+ /*
+  * The receiver writes the file while it arrives. Data packets in order go straight
+  * to the write buffer, which is written out whenever it fills. A packet ahead of
+  * the next one to write waits in a ring of REORDER_PACKETS slots indexed by its
+  * sequence number, and a packet that does not fit in the ring is dropped without
+  * an ACK, so the sender sends it again later. The memory used is the same for any
+  * file size. The runs of held packets are kept as they change, so an ACK takes its
+  * SACK blocks from the first runs without scanning the ring.
+  */
  class ReliableReceiver {
     private:
      unsigned short int myUDPport;
      char* destinationFile;
+     bool direct;  // Whether to write the file with O_DIRECT
      int s;
      socklen_t slen;
      struct sockaddr_in si_me;
      struct sockaddr_in si_other;
-     FILE* fp;
-     map<uint64_t, Packet> buffer;
+     int fd;
+ 
+     char* write_buffer;     // Bytes in order that are not written yet
+     size_t buffered;        // Bytes in write_buffer
+     uint64_t file_offset;   // Bytes written to the file
+     uint64_t next_seq;      // Next data packet to write
+     Packet* reorder;        // Packets after next_seq, at seq % REORDER_PACKETS
+     vector<bool> held;      // Whether each slot of reorder holds a packet
+     uint64_t num_held;
+     map<uint64_t, uint64_t> runs;  // Held packets start to end - 1 of each run, by start
+ 
+     // Transfer summary
+     uint64_t socket_calls;  // recvmmsg, sendmmsg and sendto calls
+     uint64_t writes;
+     uint64_t max_held;
  
      void init();
+     void sendACKs(struct mmsghdr* msgs, int count);
+     bool acceptPacket(const Packet& packet);
+     void addToRuns(uint64_t seq);
+     size_t fillAck(AckHeader* ack, bool fin);
+     void appendData(const char* data, size_t len);
+     void writeBuffer(bool last);
  
     public:
-     ReliableReceiver(unsigned short int myUDPport, char* destinationFile);
+     ReliableReceiver(unsigned short int myUDPport, char* destinationFile, bool direct);
      ~ReliableReceiver();
      void reliablyReceive();
  };
  
- ReliableReceiver::ReliableReceiver(unsigned short int myUDPport, char* destinationFile) {
+ ReliableReceiver::ReliableReceiver(unsigned short int myUDPport, char* destinationFile, bool direct) {
      this->myUDPport = myUDPport;
      this->destinationFile = destinationFile;
+     this->direct = direct;
      this->s = 0;
      this->slen = 0;
-     this->fp = NULL;
-     this->buffer.clear();
+     this->fd = -1;
+     this->write_buffer = NULL;
+     this->buffered = 0;
+     this->file_offset = 0;
+     this->next_seq = 1;
+     this->reorder = NULL;
+     this->num_held = 0;
+     this->socket_calls = 0;
+     this->writes = 0;
+     this->max_held = 0;
  }
  
  ReliableReceiver::~ReliableReceiver() {
-     if (this->fp != NULL) {
-         fclose(this->fp);
+     if (this->fd != -1) {
+         close(this->fd);
      }
      if (this->s != 0) {
          close(this->s);
      }
+     free(this->write_buffer);
+     delete[] this->reorder;
  }
  
  void ReliableReceiver::init() {
@@ -74,71 +119,267 @@
      si_me.sin_port = htons(myUDPport);
      si_me.sin_addr.s_addr = htonl(INADDR_ANY);
  
+     // Room for the packets that arrive while the file is being written
+     int rcvbuf = SOCKET_BUFFER_BYTES;
+     if (setsockopt(s, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) == -1) {
+         perror("setsockopt");
+     }
+ 
      if (bind(s, (struct sockaddr*)&si_me, sizeof(si_me)) == -1) {
          perror("bind");
          exit(1);
      }
  
-     fp = fopen(destinationFile, "wb");
-     if (fp == NULL) {
-         perror("fopen");
+     if (direct) {
+         fd = open(destinationFile, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0666);
+         if (fd == -1 && errno == EINVAL) {
+             fprintf(stderr, "[!] %s does not support O_DIRECT, writing it through the page cache\n", destinationFile);
+             direct = false;
+         }
+     }
+     if (!direct) {
+         fd = open(destinationFile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+     }
+     if (fd == -1) {
+         perror("open");
+         exit(1);
+     }
+ 
+     // O_DIRECT needs an aligned buffer, and the page cache copes best with one too
+     if (posix_memalign((void**)&write_buffer, WRITE_ALIGNMENT, WRITE_BUFFER_BYTES) != 0) {
+         fprintf(stderr, "Could not allocate the write buffer\n");
          exit(1);
      }
+     reorder = new Packet[REORDER_PACKETS];  // Left uninitialized, so only the slots used take memory
+     held.assign(REORDER_PACKETS, false);
      return;
  }
  
- void ReliableReceiver::reliablyReceive() {
-     init();
+ /*
+  * Write the buffered bytes at the end of the file. With O_DIRECT every write is a
+  * multiple of WRITE_ALIGNMENT, so the last one is padded with zeros and the file
+  * is cut back to its size afterwards.
+  */
+ void ReliableReceiver::writeBuffer(bool last) {
+     size_t len = buffered;
+     if (direct && last) {
+         len = (buffered + WRITE_ALIGNMENT - 1) / WRITE_ALIGNMENT * WRITE_ALIGNMENT;
+         memset(write_buffer + buffered, 0, len - buffered);
+     }
+     size_t done = 0;
+     while (done < len) {
+         ssize_t n = pwrite(fd, write_buffer + done, len - done, file_offset + done);
+         writes++;
+         if (n == -1 && errno == EINTR) {
+             continue;
+         }
+         if (n == -1) {
+             perror("pwrite");
+             exit(1);
+         }
+         done += n;
+     }
+     file_offset += buffered;
+     buffered = 0;
+     if (direct && last && ftruncate(fd, file_offset) == -1) {
+         perror("ftruncate");
+         exit(1);
+     }
+ }
+ 
+ // Add bytes in order to the write buffer, writing it out whenever it fills
+ void ReliableReceiver::appendData(const char* data, size_t len) {
+     while (len > 0) {
+         size_t n = min(len, (size_t)WRITE_BUFFER_BYTES - buffered);
+         memcpy(write_buffer + buffered, data, n);
+         buffered += n;
+         data += n;
+         len -= n;
+         if (buffered == WRITE_BUFFER_BYTES) {
+             writeBuffer(false);
+         }
+     }
+ }
+ 
+ /*
+  * Take a data packet: write it if it is the next one, along with the packets held
+  * after it, or hold it until then. Return whether to ACK it, which is false only
+  * for a packet too far ahead to be held.
+  */
+ bool ReliableReceiver::acceptPacket(const Packet& packet) {
+     uint64_t seq = packet.seq;
+     if (seq < next_seq) {
+         return true;  // Written already, the ACK was lost
+     }
+     if (seq >= next_seq + REORDER_PACKETS) {
+ #ifdef DEBUG
+         printf("[!] Dropped packet %" PRIu64 ", beyond the reorder buffer\n", seq);
+ #endif
+         return false;
+     }
+     if (seq > next_seq) {
+         int slot = seq % REORDER_PACKETS;
+         if (!held[slot]) {
+             reorder[slot] = packet;
+             held[slot] = true;
+             num_held++;
+             max_held = max(max_held, num_held);
+             addToRuns(seq);
+         }
+         return true;
+     }
+ 
+     appendData(packet.data, packet.len);
+     next_seq++;
+     while (held[next_seq % REORDER_PACKETS]) {
+         int slot = next_seq % REORDER_PACKETS;
+         appendData(reorder[slot].data, reorder[slot].len);
+         held[slot] = false;
+         num_held--;
+         next_seq++;
+     }
+     // The packets just written were the first run, if any was held right after the gap
+     if (!runs.empty() && runs.begin()->first < next_seq) {
+         runs.erase(runs.begin());
+     }
+     return true;
+ }
  
-     Packet packet;
+ // Add a newly held packet to the runs, joining the runs on either side of it
+ void ReliableReceiver::addToRuns(uint64_t seq) {
+     auto after = runs.upper_bound(seq);
+     bool joins_after = after != runs.end() && after->first == seq + 1;
+     if (after != runs.begin() && prev(after)->second == seq) {
+         auto before = prev(after);
+         before->second = joins_after ? after->second : seq + 1;
+         if (joins_after) runs.erase(after);
+     } else if (joins_after) {
+         runs.emplace_hint(after, seq, after->second);
+         runs.erase(after);
+     } else {
+         runs.emplace_hint(after, seq, seq + 1);
+     }
+ }
  
-     while (1) {
-         int recv_len = recvfrom(s, &packet, sizeof(packet), 0, (struct sockaddr*)&si_other, &slen);
-         if (recv_len == -1) {
-             perror("recvfrom");
+ // Fill the ACK of everything received so far, and return its size in bytes
+ size_t ReliableReceiver::fillAck(AckHeader* ack, bool fin) {
+     ack->cumulative = next_seq;
+     ack->num_blocks = 0;
+     ack->fin = fin;
+     for (auto it = runs.begin(); it != runs.end() && ack->num_blocks < MAX_SACK_BLOCKS; ++it) {
+         SackBlock& block = ack->blocks[ack->num_blocks++];
+         block.start = it->first;
+         block.end = it->second;
+     }
+     return ACK_HEADER_BYTES + ack->num_blocks * sizeof(SackBlock);
+ }
+ 
+ // Send every ACK of a batch, with as few sendmmsg calls as possible
+ void ReliableReceiver::sendACKs(struct mmsghdr* msgs, int count) {
+     int sent = 0;
+     while (sent < count) {
+         int n = sendmmsg(s, msgs + sent, count - sent, 0);
+         socket_calls++;
+         if (n == -1) {
+             perror("sendmmsg");
              exit(1);
          }
+         sent += n;
+     }
+ }
  
-         buffer[packet.seq] = packet;
+ /*
+  * Receive packets in batches: wait for the first one, take every other one already
+  * there, then send the ACKs of the batch at once, one per packet, each telling
+  * what was received up to that packet.
+  * The FIN packet only comes once every data packet is ACKed, so its bytes, the
+  * last of the file, are written right after the packets before it.
+  */
+ void ReliableReceiver::reliablyReceive() {
+     init();
  
-         // Send ACK
-         if (sendto(s, &(packet.seq), sizeof(packet.seq), 0, (struct sockaddr*)&si_other, slen) == -1) {
-             perror("sendto");
+     vector<Packet> packets(BATCH_SIZE);
+     struct sockaddr_in senders[BATCH_SIZE];
+     AckHeader acks[BATCH_SIZE];
+     struct iovec packet_iov[BATCH_SIZE], ack_iov[BATCH_SIZE];
+     struct mmsghdr packet_msgs[BATCH_SIZE], ack_msgs[BATCH_SIZE];
+     memset(packet_msgs, 0, sizeof(packet_msgs));
+     memset(ack_msgs, 0, sizeof(ack_msgs));
+     for (int i = 0; i < BATCH_SIZE; i++) {
+         packet_iov[i].iov_base = &packets[i];
+         packet_iov[i].iov_len = sizeof(Packet);
+         packet_msgs[i].msg_hdr.msg_name = &senders[i];
+         packet_msgs[i].msg_hdr.msg_iov = &packet_iov[i];
+         packet_msgs[i].msg_hdr.msg_iovlen = 1;
+         ack_iov[i].iov_base = &acks[i];
+         ack_msgs[i].msg_hdr.msg_iov = &ack_iov[i];
+         ack_msgs[i].msg_hdr.msg_iovlen = 1;
+     }
+ 
+     int fin = -1;  // Slot of the FIN packet in the batch
+     while (fin == -1) {
+         for (int i = 0; i < BATCH_SIZE; i++) {
+             packet_msgs[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+         }
+         int n = recvmmsg(s, packet_msgs, BATCH_SIZE, MSG_WAITFORONE, NULL);
+         socket_calls++;
+         if (n == -1) {
+             perror("recvmmsg");
              exit(1);
          }
+ 
+         int num_acks = 0;
+         for (int i = 0; i < n && fin == -1; i++) {
  #ifdef DEBUG
-         printf("[+] Received packet %lu\n", packet.seq);
+             printf("[+] Received packet %" PRIu64 "\n", packets[i].seq);
  #endif
-         if (packet.fin) {
+             if (packets[i].fin) {
  #ifdef DEBUG
-             printf("[*] Packet %lu is FIN\n", packet.seq);
+                 printf("[*] Packet %" PRIu64 " is FIN\n", packets[i].seq);
  #endif
-             for (int i = 0; i < 5; i++) {
-                 if (sendto(s, &(packet.seq), sizeof(packet.seq), 0, (struct sockaddr*)&si_other, slen) == -1) {
-                     perror("sendto");
-                     exit(1);
-                 }
+                 appendData(packets[i].data, packets[i].len);
+                 fin = i;
+             } else if (!acceptPacket(packets[i])) {
+                 continue;
              }
-             break;
+             ack_iov[num_acks].iov_len = fillAck(&acks[num_acks], fin != -1);
+             ack_msgs[num_acks].msg_hdr.msg_name = &senders[i];
+             ack_msgs[num_acks].msg_hdr.msg_namelen = packet_msgs[i].msg_hdr.msg_namelen;
+             num_acks++;
          }
+ 
+         // Send ACKs
+         sendACKs(ack_msgs, num_acks);
      }
  
-     // Write to file, skip the first packet (which is fin packet)
-     for (auto it = std::next(buffer.begin()); it != buffer.end(); it++) {
-         fwrite(it->second.data, sizeof(char), it->second.len, fp);
+     si_other = senders[fin];
+     slen = packet_msgs[fin].msg_hdr.msg_namelen;
+     AckHeader fin_ack;
+     size_t fin_ack_len = fillAck(&fin_ack, true);
+     for (int i = 0; i < 5; i++) {
+         if (sendto(s, &fin_ack, fin_ack_len, 0, (struct sockaddr*)&si_other, slen) == -1) {
+             perror("sendto");
+             exit(1);
+         }
+         socket_calls++;
      }
-     // Write the last packet
-     fwrite(buffer.begin()->second.data, sizeof(char), buffer.begin()->second.len, fp);
+ 
+     writeBuffer(true);
+     printf("[*] Received %" PRIu64 " bytes with %" PRIu64 " socket syscalls, %.1f per MB, in %" PRIu64 " writes\n",
+            file_offset, socket_calls, (file_offset > 0) ? socket_calls / (file_offset / 1e6) : 0.0, writes);
+     printf("[*] At most %" PRIu64 " packets held out of order\n", max_held);
+ #ifdef DEBUG
+     printf("[*] Debug logging is on, its stdout writes are not counted above\n");
+ #endif
  }
  
  int main(int argc, char** argv) {
-     if (argc != 3) {
-         fprintf(stderr, "usage: %s UDP_port filename_to_write\n\n", argv[0]);
+     if (argc != 3 && !(argc == 4 && strcmp(argv[3], "--direct") == 0)) {
+         fprintf(stderr, "usage: %s UDP_port filename_to_write [--direct]\n\n", argv[0]);
          exit(1);
      }
  
-     ReliableReceiver receiver((unsigned short int)atoi(argv[1]), argv[2]);
+     ReliableReceiver receiver((unsigned short int)atoi(argv[1]), argv[2], argc == 4);
  
      receiver.reliablyReceive();
  }
- 
\ No newline at end of file
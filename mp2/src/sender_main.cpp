@@ -7,27 +7,32 @@
 
  #include <arpa/inet.h>
  #include <errno.h>
+ #include <fcntl.h>
  #include <netinet/in.h>
  #include <pthread.h>
  #include <signal.h>
  #include <stdio.h>
  #include <stdlib.h>
  #include <string.h>
+ #include <sys/mman.h>
  #include <sys/socket.h>
  #include <sys/stat.h>
  #include <sys/time.h>
  #include <sys/types.h>
+ #include <sys/uio.h>
+ #include <time.h>
  #include <unistd.h>
  
+ #include <algorithm>
+ #include <cinttypes>
  #include <cmath>
  #include <iostream>
- #include <unordered_map>
  #include <vector>
  
  #include "packet.h"
  #include "params.h"
  
- #define DEBUG_SEND 1
+ // #define DEBUG_SEND 1  // Logs every packet, one flushed stdout write each
  // #define DEBUG_INFO 1
  // #define DEBUG_NEWACK 1
  // #define DEBUG_DUPACK 1
@@ -41,13 +46,210 @@
      uint64_t fast_recovery_count = 0;
  } state_count;
  
+ /*
+  * The bytes to send, read by offset for every transmission and retransmission.
+  * A regular file is mapped into memory once, so a packet points straight into the
+  * mapping without any syscall or copy. Anything that cannot be mapped (a pipe, a
+  * terminal) is streamed instead: it is read sequentially, and the bytes stay in
+  * memory until release() says they are acknowledged.
+  */
+ class FileSource {
+    private:
+     int fd;
+     char* map;              // Mapping of the file, NULL when streaming
+     uint64_t map_len;       // Bytes of the file that are mapped
+     vector<char> window;    // Streamed bytes from window_start on
+     uint64_t window_start;  // Offset of the first byte of window
+     bool eof;               // Whether the stream has ended
+     uint64_t reads;         // read() calls on the stream
+ 
+     void readUntil(uint64_t end);
+ 
+    public:
+     FileSource();
+     ~FileSource();
+ 
+     bool open(const char* filename, uint64_t bytes);
+     void fetch(uint64_t end);
+     size_t data(uint64_t offset, size_t len, const char** bytes);
+     void release(uint64_t offset);
+     bool isMapped() { return map != NULL; }
+     uint64_t getReads() { return reads; }
+ };
+ 
+ FileSource::FileSource() {
+     this->fd = -1;
+     this->map = NULL;
+     this->map_len = 0;
+     this->window_start = 0;
+     this->eof = false;
+     this->reads = 0;
+ }
+ 
+ FileSource::~FileSource() {
+     if (map != NULL) {
+         munmap(map, map_len);
+     }
+     if (fd != -1) {
+         close(fd);
+     }
+ }
+ 
+ // Open the first bytes of the file, mapping it if it is a regular file
+ bool FileSource::open(const char* filename, uint64_t bytes) {
+     fd = ::open(filename, O_RDONLY);
+     if (fd == -1) {
+         return false;
+     }
+     struct stat st;
+     if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && bytes > 0) {
+         map_len = min(bytes, (uint64_t)st.st_size);
+         void* addr = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+         if (addr != MAP_FAILED) {
+             map = (char*)addr;
+             madvise(map, map_len, MADV_SEQUENTIAL);
+             return true;
+         }
+         map_len = 0;
+     }
+     return true;  // Stream it
+ }
+ 
+ // Read the stream until it holds the bytes before end, or until it ends
+ void FileSource::readUntil(uint64_t end) {
+     while (!eof && window_start + window.size() < end) {
+         size_t used = window.size();
+         window.resize(used + max<uint64_t>(end - window_start - used, 1 << 20));
+         ssize_t n = read(fd, window.data() + used, window.size() - used);
+         reads++;
+         if (n == -1 && errno == EINTR) {
+             window.resize(used);
+             continue;
+         }
+         if (n == -1) {
+             perror("read");
+             exit(1);
+         }
+         window.resize(used + n);
+         eof = (n == 0);
+     }
+ }
+ 
+ // Make the bytes before end available to data(), reading them if the file is streamed
+ void FileSource::fetch(uint64_t end) {
+     if (map == NULL) {
+         readUntil(end);
+     }
+ }
+ 
+ /*
+  * Point bytes at the len bytes at offset, fetched before, and return how many of
+  * them there are, fewer than len past the end of the input. The pointer stays
+  * valid until the next fetch or release, and for a mapped file until the source
+  * is destroyed.
+  */
+ size_t FileSource::data(uint64_t offset, size_t len, const char** bytes) {
+     const char* base = (map != NULL) ? map : window.data();
+     uint64_t start = (map != NULL) ? 0 : window_start;
+     uint64_t end = (map != NULL) ? map_len : window_start + window.size();
+     *bytes = base;
+     if (offset < start || offset >= end) {
+         return 0;
+     }
+     *bytes = base + (offset - start);
+     return min<uint64_t>(len, end - offset);
+ }
+ 
+ // Forget the streamed bytes before offset, which will not be sent again
+ void FileSource::release(uint64_t offset) {
+     if (map != NULL || offset <= window_start) {
+         return;
+     }
+     size_t drop = min<uint64_t>(offset - window_start, window.size());
+     // Only move the rest to the front once it is smaller than what goes, so each byte moves once on average
+     if (drop < window.size() - drop) {
+         return;
+     }
+     window.erase(window.begin(), window.begin() + drop);
+     window_start += drop;
+ }
+ 
+ /*
+  * Which packets from base on are ACKed, cumulatively or by a SACK block, as a ring
+  * of SEND_WINDOW_PACKETS bits indexed by sequence number. Packets before base
+  * count as ACKed, and packets from base + SEND_WINDOW_PACKETS on cannot be marked
+  * yet. A bit is cleared when base moves past it, ready for the packet that reuses it.
+  */
+ class AckWindow {
+    private:
+     uint64_t bits[SEND_WINDOW_PACKETS / 64];
+     uint64_t base;  // First packet not ACKed
+ 
+    public:
+     AckWindow();
+ 
+     bool isAcked(uint64_t seq);
+     uint64_t mark(uint64_t start, uint64_t end);
+     uint64_t advance();
+ };
+ 
+ AckWindow::AckWindow() {
+     memset(this->bits, 0, sizeof(this->bits));
+     this->base = 1;  // The first data packet
+ }
+ 
+ bool AckWindow::isAcked(uint64_t seq) {
+     if (seq < base || seq >= base + SEND_WINDOW_PACKETS) {
+         return seq < base;
+     }
+     uint64_t slot = seq % SEND_WINDOW_PACKETS;
+     return (bits[slot / 64] >> (slot % 64)) & 1;
+ }
+ 
+ // Mark the packets from start to end - 1 as ACKed a word at a time, and return how many were not before
+ uint64_t AckWindow::mark(uint64_t start, uint64_t end) {
+     start = max(start, base);
+     end = min(end, base + SEND_WINDOW_PACKETS);
+     uint64_t newly_acked = 0;
+     while (start < end) {
+         // Up to the end of the word of start, which never wraps around the ring
+         uint64_t slot = start % SEND_WINDOW_PACKETS;
+         uint64_t count = min<uint64_t>(end - start, 64 - slot % 64);
+         uint64_t mask = ((count == 64) ? ~0ULL : ((1ULL << count) - 1)) << (slot % 64);
+         newly_acked += __builtin_popcountll(mask & ~bits[slot / 64]);
+         bits[slot / 64] |= mask;
+         start += count;
+     }
+     return newly_acked;
+ }
+ 
+ // Move base past the packets ACKed in a row a word at a time, clearing their bits, and return it
+ uint64_t AckWindow::advance() {
+     while (true) {
+         uint64_t slot = base % SEND_WINDOW_PACKETS;
+         int offset = slot % 64;
+         uint64_t& word = bits[slot / 64];
+         uint64_t rest = word >> offset;  // base and the packets after it in the same word
+         int ones = (rest == (~0ULL >> offset)) ? 64 - offset : __builtin_ctzll(~rest);
+         if (ones == 0) {
+             break;
+         }
+         word &= ~(((ones == 64) ? ~0ULL : ((1ULL << ones) - 1)) << offset);
+         base += ones;
+         if (ones < 64 - offset) {
+             break;
+         }
+     }
+     return base;
+ }
+ 
  class ReliableSender {
     private:
      char* hostname;
      unsigned short int hostUDPport;
      char* filename;
      unsigned long long int bytesToTransfer;
-     FILE* fp;
+     FileSource source;
      int sockfd;
      socklen_t slen;
      struct sockaddr_in si_other;
@@ -63,15 +265,32 @@
      double cwnd;
      double ssthresh;
  
-     unordered_map<uint64_t, bool> acked;
+     AckWindow acked;
+     uint64_t highest_sacked;   // End of the highest SACK block, the packets below it without an ACK are lost
+     uint64_t recover;          // Highest packet sent when a hole was last retransmitted
+     uint64_t retransmit_next;  // First packet the last round of retransmissions has not reached
+ 
+     // Packets waiting for the next sendmmsg
+     uint64_t queued_seq[BATCH_SIZE];
+     bool queued_fin[BATCH_SIZE];
+     int num_queued;
+ 
+     // Transfer summary
+     struct timespec start_time;
+     uint64_t packets_sent;
+     uint64_t packets_resent;  // Packets sent again, at or below highest_sent
+     uint64_t highest_sent;
+     uint64_t socket_calls;  // sendmmsg and recvmmsg calls
  
      void init();
      void startTimer();
-     Packet getPacket(uint64_t seq, uint64_t len, bool fin);
-     void sendPacket(Packet packet);
+     void queuePacket(uint64_t seq, bool fin);
+     void flushPackets();
      void transmitPackets(bool isRetransmit);
-     void newACKHandler(const uint64_t ack);
-     void dupACKHandler(const uint64_t ack);
+     void retransmitHoles();
+     uint64_t applyAck(const AckHeader& ack);
+     void newACKHandler(const AckHeader& ack);
+     void dupACKHandler(const AckHeader& ack);
      void TimeoutHandler();
  
     public:
@@ -81,6 +300,7 @@
      void reliablyTransfer();
  
      void printInfo();
+     void printSummary();
  };
  
  ReliableSender::ReliableSender(char* hostname, unsigned short int hostUDPport, char* filename, unsigned long long int bytesToTransfer) {
@@ -89,11 +309,11 @@
      this->filename = filename;
      this->bytesToTransfer = bytesToTransfer;
  
-     this->fp = NULL;
      this->sockfd = 0;
      this->slen = 0;
  
      this->num_packets = bytesToTransfer / MSS;
+     this->last_packet_byte = 0;
      if (this->num_packets < (bytesToTransfer + MSS - 1) / MSS) {
          this->last_packet_byte = bytesToTransfer % MSS;
      }
@@ -102,27 +322,31 @@
      this->state = SLOW_START;
      this->cwnd = 1.0;       // 1 window size
      this->ssthresh = 64.0;  // 64 window size
-     this->prev_sent_seq = 1;
-     this->acked.clear();
+     this->prev_sent_seq = 0;
+     this->highest_sacked = 0;
+     this->recover = 0;
+     this->retransmit_next = 0;
+     this->packets_sent = 0;
+     this->packets_resent = 0;
+     this->highest_sent = 0;
+     this->socket_calls = 0;
+     this->num_queued = 0;
  }
  
  ReliableSender::~ReliableSender() {
      if (sockfd != 0) {
          close(sockfd);
      }
-     if (fp != nullptr) {
-         fclose(fp);
-     }
  }
  
  // Initialize the sender's descriptor and open the file
  void ReliableSender::init() {
      // Open the file
-     fp = fopen(filename, "rb");
-     if (fp == NULL) {
+     if (!source.open(filename, bytesToTransfer)) {
          printf("Could not open file to send.");
          exit(1);
      }
+     clock_gettime(CLOCK_MONOTONIC, &start_time);
  
      slen = sizeof(si_other);
  
@@ -138,6 +362,7 @@
          fprintf(stderr, "inet_aton() failed\n");
          exit(1);
      }
+     startTimer();
  }
  
  // Print the current state of the sender
@@ -167,47 +392,86 @@
      cout << "[*] Slow start threshold (ssthresh): " << ssthresh << endl;
  }
  
- // Get the packet based on the sequence number
- Packet ReliableSender::getPacket(uint64_t seq, uint64_t len, bool fin) {
-     Packet packet;
-     packet.seq = seq;
-     packet.fin = fin;
-     packet.len = len;
- 
-     size_t read_len;
-     uint64_t offset = (fin) ? num_packets * MSS : (seq - 1) * MSS;
-     size_t bytes_to_read = (fin) ? last_packet_byte : len;
- 
-     if (fseek(fp, offset, SEEK_SET) != 0) {
-         perror("fseek");
-         exit(1);
-     }
-     read_len = fread(packet.data, 1, bytes_to_read, fp);
-     if (read_len < bytes_to_read && ferror(fp)) {
-         perror("fread");
-         exit(1);
-     }
- 
+ // Queue the packet with the given sequence number, or the FIN packet holding the last partial packet
+ void ReliableSender::queuePacket(uint64_t seq, bool fin) {
  #ifdef DEBUG_SEND
+     cout << "\033[1;30m";  // Set output color to be gray
      if (fin) {
-         cout << "\033[1;30m";  // Set output color to be gray
-         cout << "[*] Read " << read_len << " bytes for the last packet" << endl;
+         cout << "[*] Sending " << last_packet_byte << " bytes in the last packet" << endl;
      }
+     cout << "[*] Sending packet " << seq << endl;
  #endif
- 
-     return packet;
+     if (num_queued == BATCH_SIZE) {
+         flushPackets();
+     }
+     queued_seq[num_queued] = seq;
+     queued_fin[num_queued] = fin;
+     num_queued++;
+     packets_sent++;
+     if (!fin && seq <= highest_sent) {
+         packets_resent++;
+     }
+     highest_sent = (fin) ? highest_sent : max(highest_sent, seq);
  }
  
- // Send the packet to the receiver
- void ReliableSender::sendPacket(Packet packet) {
- #ifdef DEBUG_SEND
-     cout << "\033[1;30m";  // Set output color to be gray
-     cout << "[*] Sending packet " << packet.seq << endl;
- #endif
-     if (sendto(sockfd, &packet, sizeof(packet), 0, (struct sockaddr*)&si_other, slen) == -1) {
-         perror("sendto");
-         exit(1);
+ /*
+  * Send the queued packets with as few sendmmsg calls as possible. Each datagram
+  * has the layout of Packet, but it is gathered from the header, the data in the
+  * source, zeros for the rest of a short packet and the trailer, so the data is
+  * never copied on the way.
+  */
+ void ReliableSender::flushPackets() {
+     static const char zeros[MSS] = {};
+     uint64_t offset[BATCH_SIZE];
+     size_t len[BATCH_SIZE];
+     PacketTrailer trailer[BATCH_SIZE];
+     struct iovec iov[BATCH_SIZE][4];
+     struct mmsghdr msgs[BATCH_SIZE];
+ 
+     // Fetch the data of every packet first, so that no pointer into the source moves while the batch is built
+     uint64_t end = 0;
+     for (int i = 0; i < num_queued; i++) {
+         offset[i] = (queued_fin[i]) ? num_packets * MSS : (queued_seq[i] - 1) * MSS;
+         len[i] = (queued_fin[i]) ? last_packet_byte : MSS;
+         end = max(end, offset[i] + len[i]);
+     }
+     source.fetch(end);
+ 
+     memset(msgs, 0, sizeof(msgs));
+     for (int i = 0; i < num_queued; i++) {
+         const char* bytes;
+         size_t available = source.data(offset[i], len[i], &bytes);
+         trailer[i] = {};
+         trailer[i].fin = queued_fin[i];
+         trailer[i].len = len[i];
+         iov[i][0].iov_base = &queued_seq[i];
+         iov[i][0].iov_len = sizeof(queued_seq[i]);
+         iov[i][1].iov_base = (void*)bytes;
+         iov[i][1].iov_len = available;
+         iov[i][2].iov_base = (void*)zeros;
+         iov[i][2].iov_len = MSS - available;
+         iov[i][3].iov_base = &trailer[i];
+         iov[i][3].iov_len = sizeof(trailer[i]);
+         msgs[i].msg_hdr.msg_name = &si_other;
+         msgs[i].msg_hdr.msg_namelen = slen;
+         msgs[i].msg_hdr.msg_iov = iov[i];
+         msgs[i].msg_hdr.msg_iovlen = 4;
+     }
+ 
+     int sent = 0;
+     while (sent < num_queued) {
+         int n = sendmmsg(sockfd, msgs + sent, num_queued - sent, 0);
+         socket_calls++;
+         if (n == -1 && errno == EINTR) {
+             continue;
+         }
+         if (n == -1) {
+             perror("sendmmsg");
+             exit(1);
+         }
+         sent += n;
      }
+     num_queued = 0;
  }
  
  // Set timeout for the socket
@@ -223,30 +487,72 @@
  }
  
  /*
-  * New ACK handler in the state machine
-  * Change the congestion window size based on the current state
+  * Mark the packets the receiver has, cumulatively and in SACK blocks, then set
+  * send_base to the first encountered unacked packet. Return how many packets
+  * were not ACKed before.
+  */
+ uint64_t ReliableSender::applyAck(const AckHeader& ack) {
+     uint64_t newly_acked = acked.mark(send_base, min<uint64_t>(ack.cumulative, num_packets + 1));
+     for (uint32_t b = 0; b < ack.num_blocks; b++) {
+         uint64_t end = min<uint64_t>(ack.blocks[b].end, num_packets + 1);
+         newly_acked += acked.mark(ack.blocks[b].start, end);
+         highest_sacked = max(highest_sacked, end);
+     }
+     send_base = acked.advance();
+     return newly_acked;
+ }
+ 
+ /*
+  * Retransmit the packets below the highest SACK block that have no ACK, which the
+  * receiver is missing, each once per round. At least send_base is sent.
+  * Once a packet sent after the last retransmission is SACKed, the holes still
+  * below it were lost again, and a new round starts from send_base.
+  */
+ void ReliableSender::retransmitHoles() {
+     if (highest_sacked > recover + 1) {
+         recover = highest_sent;
+         retransmit_next = send_base;
+     }
+     uint64_t end = min(max(highest_sacked, send_base + 1), num_packets + 1);
+     for (uint64_t seq = max(retransmit_next, send_base); seq < end; seq++) {
+         if (!acked.isAcked(seq)) {
+             queuePacket(seq, false);
+             recover = highest_sent;
+         }
+     }
+     retransmit_next = max(retransmit_next, end);
+ }
+ 
+ /*
+  * New ACK handler in the state machine, for an ACK moving the cumulative ACK forward
+  * Change the congestion window size based on the current state and the packets newly ACKed
   */
- void ReliableSender::newACKHandler(const uint64_t ack) {
-     acked[ack] = true;
+ void ReliableSender::newACKHandler(const AckHeader& ack) {
+     uint64_t newly_acked = applyAck(ack);
  #ifdef DEBUG_NEWACK
      cout << "\033[1;32m";  // Set output color to be green
-     cout << "[+] Received new ACK " << ack << endl;
+     cout << "[+] Received new ACK " << ack.cumulative << " with " << ack.num_blocks << " SACK blocks" << endl;
  #endif
      switch (state) {
          case SLOW_START:
-             cwnd++;
+             cwnd += newly_acked;
              dupACKcount = 0;
              transmitPackets(false);
              break;
          case CONGESTION_AVOID:
-             cwnd += 1.0 / cwnd;
+             cwnd += newly_acked / cwnd;
              dupACKcount = 0;
              transmitPackets(false);
              break;
          case FAST_RECOVERY:
-             cwnd = ssthresh;
-             dupACKcount = 0;
-             state = CONGESTION_AVOID;
+             if (send_base > recover) {
+                 cwnd = ssthresh;
+                 dupACKcount = 0;
+                 state = CONGESTION_AVOID;
+             } else {
+                 // Partial ACK, retransmit the holes the SACK blocks show since the last ones
+                 retransmitHoles();
+             }
              transmitPackets(false);
              break;
          default:
@@ -258,14 +564,15 @@
  }
  
  /*
-  * Duplicate ACK handler in the state machine
-  * If 3 duplicate ACKs are received, then perform fast recovery
-  * Otherwise, increase the congestion window size by 1
+  * Duplicate ACK handler in the state machine, for an ACK leaving the cumulative ACK where it was
+  * If 3 duplicate ACKs are received, then perform fast recovery, retransmitting only the holes
+  * In fast recovery, increase the congestion window size by the packets that left the network
   */
- void ReliableSender::dupACKHandler(const uint64_t ack) {
+ void ReliableSender::dupACKHandler(const AckHeader& ack) {
+     uint64_t newly_acked = applyAck(ack);
  #ifdef DEBUG_DUPACK
      cout << "\033[1;33m";  // Set output color to be yellow
-     cout << "[*] Received duplicate ACK " << ack << endl;
+     cout << "[*] Received duplicate ACK " << ack.cumulative << " with " << ack.num_blocks << " SACK blocks" << endl;
  #endif
      switch (state) {
          case SLOW_START:
@@ -275,11 +582,14 @@
                  ssthresh = cwnd / 2;
                  cwnd = ssthresh + 3;
                  state = FAST_RECOVERY;
-                 transmitPackets(true);
+                 recover = highest_sent;
+                 retransmit_next = send_base;
+                 retransmitHoles();
              }
              break;
          case FAST_RECOVERY:
-             cwnd++;
+             cwnd += newly_acked;
+             retransmitHoles();
              transmitPackets(false);
              break;
          default:
@@ -329,16 +639,17 @@
  }
  
  /*
-  * Transmit packets and start the timer for the first packet
+  * Queue packets for transmission, they are sent by the next flushPackets
   * If isRetransmit is true, then retransmit the packets starting from the send_base (all packets)
   * Otherwise, transmit the packets starting from the nextseqnum (new packets)
   *
   */
  void ReliableSender::transmitPackets(bool isRetransmit) {
-     startTimer();
+     // Packets past the ring of acked could not be tracked, nor held by the receiver
+     cwnd = min(cwnd, (double)SEND_WINDOW_PACKETS);
      if (send_base > num_packets) {
          // Send FIN packet
-         sendPacket(getPacket(0, last_packet_byte, true));
+         queuePacket(0, true);
          return;
      }
  
@@ -347,65 +658,108 @@
  
      while (nextseqnum <= num_packets && nextseqnum < send_base + cwnd) {
          // Skip if packet is already acked
-         if (acked[nextseqnum] == true) {
+         if (acked.isAcked(nextseqnum)) {
              nextseqnum++;
              continue;
          }
  
-         sendPacket(getPacket(nextseqnum, MSS, false));
+         queuePacket(nextseqnum, false);
          nextseqnum++;
      }
      prev_sent_seq = nextseqnum - 1;
  }
  
- // Main function to reliably transfer the file
+ /*
+  * Main function to reliably transfer the file
+  * ACKs are drained in batches: the first one is waited for, and every other one
+  * already received comes with it. The packets they release are sent together
+  * once the whole batch is handled.
+  */
  void ReliableSender::reliablyTransfer() {
      init();
  
      transmitPackets(false);
-     startTimer();
-     uint64_t ack;
-     while (true) {
-         if (cwnd >= ssthresh && state == SLOW_START) {
-             state = CONGESTION_AVOID;
-         }
+     flushPackets();
+ 
+     AckHeader acks[BATCH_SIZE];
+     struct iovec iov[BATCH_SIZE];
+     struct mmsghdr msgs[BATCH_SIZE];
+     memset(msgs, 0, sizeof(msgs));
+     for (int i = 0; i < BATCH_SIZE; i++) {
+         iov[i].iov_base = &acks[i];
+         iov[i].iov_len = sizeof(acks[i]);
+         msgs[i].msg_hdr.msg_iov = &iov[i];
+         msgs[i].msg_hdr.msg_iovlen = 1;
+     }
  
-         // Receive ACK
-         int recv_len = recvfrom(sockfd, &ack, sizeof(ack), 0, (struct sockaddr*)&si_other, &slen);
-         if (recv_len == -1 && (errno != EAGAIN || errno != EWOULDBLOCK)) {
-             perror("recvfrom");
-             exit(1);
-         }
-         if (ack == 0) {
-             cout << "\033[1;30m";
-             cout << "[*] Received FIN ACK" << endl;
-             break;
-         }
+     bool finished = false;
+     while (!finished) {
+         // Receive ACKs
+         int n = recvmmsg(sockfd, msgs, BATCH_SIZE, MSG_WAITFORONE, NULL);
+         socket_calls++;
          // Timeout
-         if (recv_len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+         if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
              TimeoutHandler();
+             flushPackets();
              continue;
          }
- 
-         if (acked[ack] == false) {
-             // New ACK
-             newACKHandler(ack);
-         } else {
-             // Duplicate ACK
-             dupACKHandler(ack);
+         if (n == -1 && errno != EINTR) {
+             perror("recvmmsg");
+             exit(1);
          }
  
-         // Set send_base to the first encountered unacked packet
-         while (acked[send_base] == true) {
-             send_base++;
+         for (int i = 0; i < n; i++) {
+             const AckHeader& ack = acks[i];
+             if (msgs[i].msg_len < ACK_HEADER_BYTES || ack.num_blocks > MAX_SACK_BLOCKS ||
+                 msgs[i].msg_len < ACK_HEADER_BYTES + ack.num_blocks * sizeof(SackBlock)) {
+                 continue;  // Not an ACK
+             }
+             if (ack.fin) {
+                 cout << "\033[1;30m";
+                 cout << "[*] Received FIN ACK" << endl;
+                 finished = true;
+                 break;
+             }
+             if (cwnd >= ssthresh && state == SLOW_START) {
+                 state = CONGESTION_AVOID;
+             }
+ 
+             if (ack.cumulative > send_base) {
+                 // New ACK
+                 newACKHandler(ack);
+             } else {
+                 // Duplicate ACK
+                 dupACKHandler(ack);
+             }
+         }
+         if (!finished) {
+             flushPackets();
+             source.release((send_base - 1) * MSS);
          }
      }
  
      cout << "\033[0m";  // Set output color to be white
      cout << "[*] File transfer completed" << endl;
+     printSummary();
      return;
  }
  
+ // Print the bytes sent, the throughput and the packets sent
+ void ReliableSender::printSummary() {
+     struct timespec end_time;
+     clock_gettime(CLOCK_MONOTONIC, &end_time);
+     double seconds = (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+     printf("[*] Sent %llu bytes in %.3f s, %.1f MB/s, from a %s file\n", bytesToTransfer, seconds,
+            (seconds > 0) ? bytesToTransfer / seconds / 1e6 : 0.0, source.isMapped() ? "mapped" : "streamed");
+     printf("[*] %" PRIu64 " packets sent, %" PRIu64 " of them again\n", packets_sent, packets_resent);
+     uint64_t syscalls = socket_calls + source.getReads();
+     printf("[*] %" PRIu64 " socket and file syscalls, %.1f per MB\n", syscalls,
+            (bytesToTransfer > 0) ? syscalls / (bytesToTransfer / 1e6) : 0.0);
+ #if defined(DEBUG_SEND) || defined(DEBUG_INFO) || defined(DEBUG_NEWACK) || defined(DEBUG_DUPACK) || defined(DEBUG_TIMEOUT)
+     printf("[*] Debug logging is on, its stdout writes are not counted above\n");
+ #endif
+ }
+ 
  // Add signal handler to handle ctrl+C
  void signalHandler(int signum) {
      cout << "\033[0m";  // Set output color to be white
@@ -0,0 +1,27 @@
+#!/bin/bash
+# Time linkstate and distvec on generated topologies of every shape and size,
+# appending one CSV line per router and input to a file kept across runs.
+# Usage: ./bench.sh [csvfile] [sizes] [threads]
+#   ./bench.sh bench.csv "500 2000" 4
+
+csv=${1:-bench.csv}
+sizes=${2:-"250 1000 2000"}
+threads=${3:-1}
+
+make -s routebench topogen || exit 1
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+date=$(date +%Y-%m-%dT%H:%M:%S)
+if [ ! -s "$csv" ]; then
+    echo "date,commit,shape,$(./routebench suite --header)" > "$csv"
+fi
+
+for shape in geometric ba grid fattree; do
+    for nodes in $sizes; do
+        ./topogen $shape $nodes "$dir" $((nodes * 2)) 10 1 > /dev/null || exit 1
+        ./routebench suite "$dir/topofile" "$dir/messagefile" "$dir/changesfile" $threads | tail -n +2 |
+            sed "s/^/$date,$commit,$shape,/" | tee -a "$csv"
+    done
+done
@@ -0,0 +1,466 @@
+#include "area.hpp"
+
+#include <fcntl.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <unordered_map>
+
+#include "heap.hpp"
+
+AreaRouter::AreaRouter(const char *topofile, const char *messagefile) : num_nodes(0), num_areas(0) {
+    vector<Link> links;
+    if (!parseTopologyFile(topofile, links)) {
+        printf("Error opening file %s\n", topofile);
+    }
+    num_nodes = remapNodes(links, node_id, node_index);
+    g.build(num_nodes, links);
+    if (!parseMessageFile(messagefile, messages)) {
+        printf("Error opening file %s\n", messagefile);
+    }
+}
+
+bool AreaRouter::partition(const char *spec) {
+    area.assign(num_nodes, -1);
+    area_label.clear();
+    if (strncmp(spec, "auto", 4) == 0 && (spec[4] == '\0' || spec[4] == ':')) {
+        int size = (spec[4] == ':') ? atoi(spec + 5) : (int)ceil(sqrt((double)num_nodes));
+        if (size < 1) {
+            return false;
+        }
+        // Grow each area breadth first from the lowest node left, so that it is connected
+        vector<int> queue;
+        for (int start = 0; start < num_nodes; start++) {
+            if (area[start] != -1) continue;
+            int a = area_label.size();
+            area_label.push_back(a + 1);
+            area[start] = a;
+            queue.assign(1, start);
+            int taken = 1;
+            for (size_t head = 0; head < queue.size() && taken < size; head++) {
+                int u = queue[head];
+                for (int e = g.begin(u); e < g.end(u) && taken < size; e++) {
+                    int v = g.neighbor(e);
+                    if (area[v] != -1) continue;
+                    area[v] = a;
+                    queue.push_back(v);
+                    taken++;
+                }
+            }
+        }
+    } else {
+        // Input format: <node ID> <area ID>
+        MappedFile file;
+        if (!file.open(spec)) {
+            return false;
+        }
+        LineScanner scanner(file, spec);
+        unordered_map<int, int> dense;  // Area ID -> area
+        int max_label = 0;
+        while (scanner.nextLine()) {
+            int id, label;
+            if (scanner.atLineEnd()) {
+                continue;
+            }
+            if (!scanner.readInt(id) || !scanner.readInt(label) || !scanner.atLineEnd()) {
+                scanner.error("<node> <area>");
+                continue;
+            }
+            int u = (id >= 0 && id < node_index.size()) ? node_index[id] : -1;
+            if (u == -1) {
+                fprintf(stderr, "Ignoring area of node %d: node is not in the topology\n", id);
+                continue;
+            }
+            auto it = dense.find(label);
+            if (it == dense.end()) {
+                it = dense.insert({label, (int)area_label.size()}).first;
+                area_label.push_back(label);
+            }
+            area[u] = it->second;
+            max_label = max(max_label, label);
+        }
+        for (int u = 0; u < num_nodes; u++) {
+            if (area[u] != -1) continue;
+            if (area_label.empty() || area_label.back() != max_label + 1) {
+                area_label.push_back(max_label + 1);
+            }
+            area[u] = area_label.size() - 1;
+        }
+    }
+    num_areas = area_label.size();
+    layoutAreas();
+    return true;
+}
+
+// Gather the members of each area and lay out their tables
+void AreaRouter::layoutAreas() {
+    members.assign(num_areas, vector<int>());
+    local.assign(num_nodes, -1);
+    for (int u = 0; u < num_nodes; u++) {
+        local[u] = members[area[u]].size();
+        members[area[u]].push_back(u);
+    }
+    table_at.assign(num_areas + 1, 0);
+    for (int a = 0; a < num_areas; a++) {
+        table_at[a + 1] = table_at[a] + members[a].size() * members[a].size();
+    }
+    intra_dist.assign(table_at[num_areas], INT_MAX);
+    intra_next.assign(table_at[num_areas], -1);
+    dirty.assign(num_areas, 1);
+}
+
+// Update the link between node IDs u and v, removing it if w is -999
+void AreaRouter::updateEdge(int u, int v, int w) {
+    int iu = (u >= 0 && u < node_index.size()) ? node_index[u] : -1;
+    int iv = (v >= 0 && v < node_index.size()) ? node_index[v] : -1;
+    if (iu == -1 || iv == -1) {
+        fprintf(stderr, "Ignoring change %d %d %d: node is not in the topology\n", u, v, w);
+        return;
+    }
+    g.removeEdge(iu, iv);
+    if (w != -999) {
+        g.addEdge(iu, iv, w);
+    }
+    // A link between areas only changes the routes to other areas, which are always recomputed
+    if (area[iu] == area[iv]) {
+        dirty[area[iu]] = 1;
+    }
+}
+
+void AreaRouter::calculate(ThreadPool &pool) {
+    vector<int> areas;
+    for (int a = 0; a < num_areas; a++) {
+        if (dirty[a]) areas.push_back(a);
+    }
+    pool.parallelFor(areas.size(), [&](int i) { calculateArea(areas[i]); });
+    fill(dirty.begin(), dirty.end(), 0);
+    calculateExits(pool);
+}
+
+/*
+ * Dijkstra from every node of area a over the links inside it.
+ * Equal-cost routes keep the lowest predecessor and take their first hop from it,
+ * as in linkstate, so one area covering the graph gives the linkstate tables.
+ */
+void AreaRouter::calculateArea(int a) {
+    static thread_local BinaryHeap heap;
+    static thread_local vector<int> pred;
+    static thread_local vector<char> settled;
+    const vector<int> &nodes = members[a];
+    size_t size = nodes.size();
+    for (size_t i = 0; i < size; i++) {
+        int src = nodes[i];
+        int *d = &intra_dist[table_at[a] + i * size];
+        int *nh = &intra_next[table_at[a] + i * size];
+        fill(d, d + size, INT_MAX);
+        fill(nh, nh + size, -1);
+        d[i] = 0;
+        nh[i] = src;
+        pred.assign(size, -1);
+        settled.assign(size, 0);
+        heap.reset(size, 0);
+        heap.push(i, 0);
+        while (!heap.empty()) {
+            int key;
+            int x = heap.pop(key);
+            if (key > d[x] || settled[x]) continue;  // Stale entry, or lowered by a negative link once settled
+            settled[x] = 1;
+            int u = nodes[x];
+            for (int e = g.begin(u); e < g.end(u); e++) {
+                int v = g.neighbor(e);
+                if (area[v] != a) continue;
+                int y = local[v];
+                int nd = key + g.weight(e);
+                int hop = (u == src) ? v : nh[x];
+                // Members are in increasing node order, so the lowest local index is the lowest node
+                if (nd < d[y] || (nd == d[y] && (pred[y] == -1 || x < pred[y]))) {
+                    if (nd < d[y]) heap.push(y, nd);
+                    d[y] = nd;
+                    pred[y] = x;
+                    nh[y] = hop;
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Route every node to every other area with one multi-source Dijkstra per area
+ * over the whole graph, from all the nodes of the area at once. The cost a node
+ * gets is its shortest path cost to the nearest node of the area, through any
+ * area, not an OSPF sum of an intra-area cost and a border summary. The parent
+ * of a node in the search is its next hop, ties going to the lowest one.
+ */
+void AreaRouter::calculateExits(ThreadPool &pool) {
+    exit_cost.assign((size_t)num_nodes * num_areas, INT_MAX);
+    exit_next.assign((size_t)num_nodes * num_areas, -1);
+    pool.parallelFor(num_areas, [this](int a) {
+        static thread_local BinaryHeap heap;
+        static thread_local vector<int> d, parent;
+        static thread_local vector<char> settled;
+        d.assign(num_nodes, INT_MAX);
+        parent.assign(num_nodes, -1);
+        settled.assign(num_nodes, 0);
+        heap.reset(num_nodes, 0);
+        for (int u : members[a]) {
+            d[u] = 0;
+            heap.push(u, 0);
+        }
+        while (!heap.empty()) {
+            int key;
+            int u = heap.pop(key);
+            if (key > d[u] || settled[u]) continue;  // Stale entry, or lowered by a negative link once settled
+            settled[u] = 1;
+            for (int e = g.begin(u); e < g.end(u); e++) {
+                int v = g.neighbor(e);
+                int nd = key + g.weight(e);
+                if (nd < d[v] || (nd == d[v] && u < parent[v])) {
+                    if (nd < d[v]) heap.push(v, nd);
+                    d[v] = nd;
+                    parent[v] = u;
+                }
+            }
+        }
+        for (int u = 0; u < num_nodes; u++) {
+            if (area[u] == a) continue;
+            exit_cost[(size_t)u * num_areas + a] = d[u];
+            exit_next[(size_t)u * num_areas + a] = parent[u];
+        }
+    });
+}
+
+// Next hop of cur towards dest in the table of cur, -1 if it has no route
+int AreaRouter::nextHop(int cur, int dest) {
+    if (area[cur] == area[dest]) {
+        return intraDist(cur, dest) == INT_MAX ? -1 : intraNext(cur, dest);
+    }
+    return exit_next[(size_t)cur * num_areas + area[dest]];
+}
+
+/*
+ * Forward from src to dest hop by hop into path, without the last node, and sum
+ * the link costs along the way into cost. Return false if the message is dropped.
+ */
+bool AreaRouter::getPath(int src, int dest, vector<int> &path, long long &cost) {
+    path.clear();
+    cost = 0;
+    if (src == -1 || dest == -1 || src == dest) {
+        return false;
+    }
+    int cur = src;
+    while (cur != dest) {
+        int hop = nextHop(cur, dest);
+        if (hop == -1 || path.size() == num_nodes) {
+            path.clear();  // No route, or a loop over zero-cost links
+            return false;
+        }
+        path.push_back(cur);
+        cost += g.getWeight(cur, hop);
+        cur = hop;
+    }
+    return true;
+}
+
+/*
+ * Write the table of node: "<dest> <next hop> <cost>" for the nodes of its area,
+ * then "area <area ID> <next hop> <cost>" for every other area it can reach.
+ */
+void AreaRouter::writeForwardingTable(int node, OutputBuffer *out, OutputBuffer *console) {
+    if (console != NULL) {
+        console->putString("Forwarding table for node ");
+        console->putInt(node_id[node]);
+        console->putString(":\nDest\tNext Hop\tCost\n");
+    }
+    OutputBuffer *buffers[2] = {out, console};
+    for (OutputBuffer *buffer : buffers) {
+        if (buffer == NULL) continue;
+        char sep = (buffer == out) ? ' ' : '\t';
+        for (int dest : members[area[node]]) {
+            if (intraDist(node, dest) == INT_MAX) continue;
+            buffer->putInt(node_id[dest]);
+            buffer->putChar(sep);
+            buffer->putInt(node_id[intraNext(node, dest)]);
+            buffer->putString(buffer == out ? " " : "\t\t");
+            buffer->putInt(intraDist(node, dest));
+            buffer->putChar('\n');
+        }
+        for (int y = 0; y < num_areas; y++) {
+            int hop = exit_next[(size_t)node * num_areas + y];
+            if (hop == -1) continue;
+            buffer->putString("area ");
+            buffer->putInt(area_label[y]);
+            buffer->putChar(sep);
+            buffer->putInt(node_id[hop]);
+            buffer->putString(buffer == out ? " " : "\t\t");
+            buffer->putInt(exit_cost[(size_t)node * num_areas + y]);
+            buffer->putChar('\n');
+        }
+    }
+}
+
+// Write every message as in BaseRouter::writeMessage, with the cost of the links it went through
+void AreaRouter::writeMessages(OutputBuffer *out, OutputBuffer *console) {
+    vector<int> path;
+    OutputBuffer *buffers[2] = {out, console};
+    for (auto &msg : messages) {
+        int src = (msg.src >= 0 && msg.src < node_index.size()) ? node_index[msg.src] : -1;
+        int dest = (msg.dest >= 0 && msg.dest < node_index.size()) ? node_index[msg.dest] : -1;
+        long long cost;
+        bool routed = getPath(src, dest, path, cost);
+        for (OutputBuffer *buffer : buffers) {
+            if (buffer == NULL) continue;
+            buffer->putString("from ");
+            buffer->putInt(msg.src);
+            buffer->putString(" to ");
+            buffer->putInt(msg.dest);
+            if (!routed) {
+                buffer->putString(" cost infinite hops unreachable message ");
+            } else {
+                buffer->putString(" cost ");
+                buffer->putInt(cost);
+                buffer->putString(" hops ");
+                for (int hop : path) {
+                    buffer->putInt(node_id[hop]);
+                    buffer->putChar(' ');
+                }
+                buffer->putString("message ");
+            }
+            buffer->putString(msg.message.data(), msg.message.size());
+            buffer->putChar('\n');
+        }
+    }
+}
+
+void AreaRouter::reportStats(ThreadPool &pool, int epoch) {
+    long long entries = 0;
+    int borders = 0;
+    for (int u = 0; u < num_nodes; u++) {
+        for (int e = g.begin(u); e < g.end(u); e++) {
+            if (area[g.neighbor(e)] != area[u]) {
+                borders++;
+                break;
+            }
+        }
+        for (int v : members[area[u]]) {
+            if (intraDist(u, v) != INT_MAX) entries++;
+        }
+        for (int y = 0; y < num_areas; y++) {
+            if (exit_next[(size_t)u * num_areas + y] != -1) entries++;
+        }
+    }
+    double bytes = (intra_dist.size() + intra_next.size() + exit_cost.size() + exit_next.size()) * sizeof(int);
+    double dense_bytes = 3.0 * num_nodes * num_nodes * sizeof(int);
+    fprintf(stderr,
+            "[*] Epoch %d: %d areas, %d borders, %.1f table entries per node (%d without areas), "
+            "%.1f MB of tables (%.1f MB without areas)\n",
+            epoch, num_areas, borders, num_nodes > 0 ? (double)entries / num_nodes : 0.0, num_nodes,
+            bytes / 1e6, dense_bytes / 1e6);
+
+    // Shortest path costs of the messages, one Dijkstra over the whole graph per source
+    vector<vector<int>> by_source(num_nodes);
+    vector<int> sources;
+    for (int i = 0; i < messages.size(); i++) {
+        int src = (messages[i].src >= 0 && messages[i].src < node_index.size()) ? node_index[messages[i].src] : -1;
+        int dest =
+            (messages[i].dest >= 0 && messages[i].dest < node_index.size()) ? node_index[messages[i].dest] : -1;
+        if (src == -1 || dest == -1 || src == dest) continue;
+        if (by_source[src].empty()) sources.push_back(src);
+        by_source[src].push_back(i);
+    }
+    vector<int> shortest(messages.size(), INT_MAX);
+    pool.parallelFor(sources.size(), [&](int k) {
+        static thread_local BinaryHeap heap;
+        static thread_local vector<int> d;
+        static thread_local vector<char> settled;
+        d.assign(num_nodes, INT_MAX);
+        settled.assign(num_nodes, 0);
+        heap.reset(num_nodes, 0);
+        d[sources[k]] = 0;
+        heap.push(sources[k], 0);
+        while (!heap.empty()) {
+            int key;
+            int u = heap.pop(key);
+            if (key > d[u] || settled[u]) continue;  // Stale entry, or lowered by a negative link once settled
+            settled[u] = 1;
+            for (int e = g.begin(u); e < g.end(u); e++) {
+                int v = g.neighbor(e);
+                if (key + g.weight(e) < d[v]) {
+                    d[v] = key + g.weight(e);
+                    heap.push(v, d[v]);
+                }
+            }
+        }
+        for (int i : by_source[sources[k]]) {
+            shortest[i] = d[node_index[messages[i].dest]];
+        }
+    });
+
+    vector<int> path;
+    int routed = 0, longer = 0, lost = 0;
+    double sum = 0, worst = 1;
+    for (int src : sources) {
+        for (int i : by_source[src]) {
+            if (shortest[i] == INT_MAX) continue;
+            long long cost;
+            if (!getPath(src, node_index[messages[i].dest], path, cost)) {
+                lost++;
+                continue;
+            }
+            double stretch = shortest[i] > 0 ? (double)cost / shortest[i] : 1.0;
+            routed++;
+            sum += stretch;
+            worst = max(worst, stretch);
+            if (cost > shortest[i]) longer++;
+        }
+    }
+    fprintf(stderr,
+            "[*] Epoch %d: stretch of routing to the nearest node of each area, over %d routed messages: mean %.3f, "
+            "max %.3f, %d longer than the shortest path, %d reachable but dropped\n",
+            epoch, routed, routed > 0 ? sum / routed : 1.0, worst, longer, lost);
+}
+
+/*
+ * The main loop of linkstate with --areas: the tables of every node and the messages,
+ * once for the initial topology and once after every epoch of changes.
+ */
+int runAreaRouting(const char *topofile, const char *messagefile, const char *changesfile,
+                   const RouterOptions &opts) {
+    ThreadPool pool(opts.threads);
+    AreaRouter router(topofile, messagefile);
+    if (!router.partition(opts.areas)) {
+        printf("Invalid areas %s, expected auto, auto:SIZE or a file of <node> <area> lines\n", opts.areas);
+        return -1;
+    }
+    vector<vector<Change>> epochs;
+    if (!readChangeEpochs(changesfile, opts, epochs)) {
+        printf("Error opening file %s\n", changesfile);
+        return -1;
+    }
+    int fdOut = open("output.txt", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fdOut == -1) {
+        printf("Error opening file output.txt\n");
+        return -1;
+    }
+    OutputBuffer out(fdOut);
+    OutputBuffer stdoutBuffer(STDOUT_FILENO);
+    OutputBuffer *console = opts.quiet ? NULL : &stdoutBuffer;
+
+    for (int epoch = 0; epoch <= epochs.size(); epoch++) {
+        if (epoch > 0) {
+            for (auto &change : epochs[epoch - 1]) {
+                router.updateEdge(change.u, change.v, change.w);
+            }
+        }
+        router.calculate(pool);
+        for (int i = 0; i < router.getNumNodes(); i++) {
+            router.writeForwardingTable(i, &out, console);
+        }
+        router.writeMessages(&out, console);
+        if (opts.stats) {
+            router.reportStats(pool, epoch);
+        }
+    }
+    out.flush();
+    close(fdOut);
+    return 0;
+}
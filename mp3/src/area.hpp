@@ -0,0 +1,90 @@
+#ifndef AREA_HPP
+#define AREA_HPP
+
+#include "route.hpp"
+
+/*
+ * Routing over areas, without any num_nodes x num_nodes table.
+ *
+ * The nodes are partitioned into areas. Every node keeps:
+ *   - a full table to the other nodes of its area, over the links of the area only
+ *   - one route per other area, with the shortest path cost to the nearest node of
+ *     that area over the whole graph and the first hop towards it
+ * This is not OSPF's hierarchy: there is no backbone, and the route to an area is
+ * not built from border summaries, it may cross any area on the way.
+ * Messages are forwarded hop by hop with the table of each node they reach. With
+ * positive link costs the cost to the destination area drops at every hop, so
+ * forwarding cannot loop. Routes may be longer than the shortest paths, because
+ * a node only knows the way to the nearest node of an area, which may be far from
+ * the destination inside it; --stats reports this stretch.
+ *
+ * That takes one Dijkstra per area over the whole graph instead of one per node,
+ * and num_nodes x (area size + number of areas) table entries.
+ *
+ * An area whose links are cut inside it stays cut: like OSPF, nodes of an area
+ * do not route to each other through other areas.
+ */
+class AreaRouter {
+   public:
+    AreaRouter(const char* topofile, const char* messagefile);
+
+    /*
+     * Partition the nodes by spec:
+     *   auto        areas of about sqrt(num_nodes) nodes grown breadth first, each one connected
+     *   auto:SIZE   the same with areas of about SIZE nodes
+     *   FILE        lines of "<node ID> <area ID>", unlisted nodes form one more area
+     * Return false if the spec is malformed or the file cannot be read.
+     */
+    bool partition(const char* spec);
+
+    void updateEdge(int u, int v, int w);
+    // Recompute the tables of the areas touched by changes since the last call, then the routes to the areas
+    void calculate(ThreadPool& pool);
+
+    void writeForwardingTable(int node, OutputBuffer* out, OutputBuffer* console);
+    void writeMessages(OutputBuffer* out, OutputBuffer* console);
+    // Report the table sizes and the stretch of the message routes against the shortest paths on stderr
+    void reportStats(ThreadPool& pool, int epoch);
+
+    int getNumNodes() { return num_nodes; }
+
+   private:
+    Graph g;
+    vector<int> node_id;
+    vector<int> node_index;
+    vector<Message> messages;
+    int num_nodes;
+    int num_areas;
+
+    vector<int> area;              // Area of each node
+    vector<int> area_label;        // Area ID printed for each area
+    vector<vector<int>> members;   // Nodes of each area in increasing order
+    vector<int> local;             // Index of each node among the members of its area
+    vector<size_t> table_at;       // Start of the size x size tables of each area in intra_dist and intra_next
+    vector<int> intra_dist;        // Cost between two nodes of an area over its own links
+    vector<int> intra_next;        // Next hop (dense index) between two nodes of an area
+    vector<char> dirty;            // Whether the tables of each area must be recomputed
+
+    vector<int> exit_cost;         // Cost from each node to each other area, num_nodes x areas
+    vector<int> exit_next;         // First hop from each node towards each other area, -1 if unreachable
+
+    int intraDist(int u, int v) {
+        size_t size = members[area[u]].size();
+        return intra_dist[table_at[area[u]] + local[u] * size + local[v]];
+    }
+    int intraNext(int u, int v) {
+        size_t size = members[area[u]].size();
+        return intra_next[table_at[area[u]] + local[u] * size + local[v]];
+    }
+
+    void layoutAreas();
+    void calculateArea(int a);
+    void calculateExits(ThreadPool& pool);
+    int nextHop(int cur, int dest);
+    bool getPath(int src, int dest, vector<int>& path, long long& cost);
+};
+
+int runAreaRouting(const char* topofile, const char* messagefile, const char* changesfile,
+                   const RouterOptions& opts);
+
+#endif
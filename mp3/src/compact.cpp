@@ -0,0 +1,92 @@
+/*
+ * Compact storage of the routing tables.
+ *
+ * The default layout keeps dist, prev and next as num_nodes x num_nodes ints,
+ * 12 bytes per (source, destination) pair, although prev is only needed to build
+ * next. In compact mode a source is computed into rows of this thread, then packed:
+ *   - the costs in 1, 2 or 4 bytes, the narrowest width holding the largest one
+ *   - the next hops as the slot of the link out of the source, in 1 or 2 bytes
+ *     for nodes with fewer than 255 or 65535 links
+ * and prev is dropped. Readers go through getCost and getNextHop, or unpackRow.
+ *
+ * Slots index the links of the source in the graph as it was when the row was
+ * packed, so every row must be recomputed after a change to the graph, which
+ * rules out the modes that keep some rows across changes.
+ */
+#include "route.hpp"
+
+// Pack count values, mapping missing_value to the all-ones pattern of the width
+void PackedRow::pack(const int *values, int count, int missing_value) {
+    missing = missing_value;
+    int lowest = 0, highest = 0;
+    for (int i = 0; i < count; i++) {
+        if (values[i] == missing) continue;
+        lowest = min(lowest, values[i]);
+        highest = max(highest, values[i]);
+    }
+    width = (lowest < 0) ? 4 : (highest < UINT8_MAX) ? 1 : (highest < UINT16_MAX) ? 2 : 4;
+    data.resize((size_t)count * width);
+    data.shrink_to_fit();  // A row that got narrower gives its memory back
+    if (width == 1) {
+        for (int i = 0; i < count; i++) {
+            data[i] = (values[i] == missing) ? UINT8_MAX : values[i];
+        }
+    } else if (width == 2) {
+        for (int i = 0; i < count; i++) {
+            uint16_t x = (values[i] == missing) ? UINT16_MAX : values[i];
+            memcpy(&data[(size_t)i * 2], &x, 2);
+        }
+    } else {
+        memcpy(data.data(), values, (size_t)count * 4);
+    }
+}
+
+// Row k of this thread, dist, prev and next being 0, 1 and 2
+int *BaseRouter::scratchRow(int k) {
+    static thread_local vector<int> rows[3];
+    if (rows[k].size() < num_nodes) {
+        rows[k].resize(num_nodes);
+    }
+    return rows[k].data();
+}
+
+// Pack the rows of src just computed on this thread
+void BaseRouter::packRow(int src) {
+    static thread_local vector<int> slot;  // Slot of the link from src to each neighbor, -1 for other nodes
+    if (slot.size() < num_nodes) {
+        slot.assign(num_nodes, -1);
+    }
+    int *d = distRow(src);
+    int *nh = nextRow(src);
+    int *port = prevRow(src);  // prev is not needed any more once next is built
+    for (int e = g.end(src) - 1; e >= g.begin(src); e--) {
+        slot[g.neighbor(e)] = e - g.begin(src);
+    }
+    for (int dest = 0; dest < num_nodes; dest++) {
+        port[dest] = (dest == src || nh[dest] < 0) ? -1 : slot[nh[dest]];
+    }
+    for (int e = g.begin(src); e < g.end(src); e++) {
+        slot[g.neighbor(e)] = -1;
+    }
+    packed_dist[src].pack(d, num_nodes, INT_MAX);
+    packed_port[src].pack(port, num_nodes, -1);
+}
+
+// Unpack the rows of src into the rows of this thread, for the readers of whole rows
+void BaseRouter::unpackRow(int src) {
+    int *d = distRow(src);
+    int *nh = nextRow(src);
+    for (int dest = 0; dest < num_nodes; dest++) {
+        d[dest] = getCost(src, dest);
+        nh[dest] = getNextHop(src, dest);
+    }
+}
+
+// Memory held by the routing tables
+double BaseRouter::getTableMB() {
+    double bytes = (dist.capacity() + prev.capacity() + next.capacity()) * sizeof(int);
+    for (int src = 0; src < packed_dist.size(); src++) {
+        bytes += packed_dist[src].data.capacity() + packed_port[src].data.capacity();
+    }
+    return bytes / 1e6;
+}
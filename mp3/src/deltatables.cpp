@@ -0,0 +1,78 @@
+/*
+ * Rebuild the full output.txt of linkstate/distvec/dvsim from the file they write with --delta.
+ * Usage: ./deltatables deltafile outputfile
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Write the full tables of one epoch followed by its messages
+static void writeEpoch(map<int, map<int, pair<int, int>>>& tables, vector<string>& messages, FILE* out) {
+    for (auto& table : tables) {
+        for (auto& entry : table.second) {
+            fprintf(out, "%d %d %d\n", entry.first, entry.second.first, entry.second.second);
+        }
+    }
+    for (auto& message : messages) {
+        fputs(message.c_str(), out);
+    }
+    messages.clear();
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        printf("Usage: ./deltatables deltafile outputfile\n");
+        return -1;
+    }
+    FILE* fp = fopen(argv[1], "r");
+    if (fp == NULL) {
+        printf("Error opening file %s\n", argv[1]);
+        return -1;
+    }
+    FILE* out = fopen(argv[2], "w");
+    if (out == NULL) {
+        printf("Error opening file %s\n", argv[2]);
+        fclose(fp);
+        return -1;
+    }
+
+    map<int, map<int, pair<int, int>>> tables;  // node -> dest -> {next hop, cost}
+    vector<string> messages;                    // Message lines of the current epoch
+    bool in_epoch = false;
+    int line_no = 0;
+    char* line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, fp) != -1) {
+        line_no++;
+        int node, dest, nexthop, cost, epoch;
+        char dash;
+        if (strncmp(line, "from ", 5) == 0) {
+            messages.push_back(line);
+        } else if (sscanf(line, "epoch %d", &epoch) == 1) {
+            if (in_epoch) {
+                writeEpoch(tables, messages, out);
+            }
+            in_epoch = true;
+        } else if (sscanf(line, "%d %d %d %d", &node, &dest, &nexthop, &cost) == 4) {
+            tables[node][dest] = {nexthop, cost};
+        } else if (sscanf(line, "%d %d %c", &node, &dest, &dash) == 3 && dash == '-') {
+            tables[node].erase(dest);
+        } else {
+            fprintf(stderr, "%s:%d: malformed line\n", argv[1], line_no);
+        }
+    }
+    if (in_epoch) {
+        writeEpoch(tables, messages, out);
+    }
+
+    free(line);
+    fclose(fp);
+    fclose(out);
+    return 0;
+}
@@ -1,104 +1,141 @@
-#include "route.hpp"
+#include <fcntl.h>
+#include <unistd.h>
 
-class DistanceVector : public BaseRouter {
-   public:
-    DistanceVector(const char *topofile, const char *messagefile) : BaseRouter(topofile, messagefile) {}
-    void calculatePaths(int src) override {
-        // Initialize distances and previous nodes
-        dist[src].clear();
-        prev[src].clear();
-        next[src].clear();
-        dist[src].resize(num_nodes + 1, INT_MAX);
-        prev[src].resize(num_nodes + 1, -1);
-        next[src].resize(num_nodes + 1, -1);
-
-        dist[src][src] = 0;
-        next[src][src] = src;
-
-        // |V| - 1 iterations
-        for (int i = 1; i <= num_nodes - 1; i++) {
-            for (auto it : g) {
-                int u = it.first;
-                if (dist[src][u] == INT_MAX) continue;  // Skip unreachable nodes
-
-                int nexthop_u = (u == src) ?  -1 : next[src][u];
-
-                for (auto edge : it.second) {
-                    int v = edge.first;
-                    int w = edge.second;
-                    int new_dist = dist[src][u] + w;
-
-                    int candidate_nexthop = (u == src) ? v : nexthop_u;
-
-                    if (new_dist < dist[src][v] || (new_dist == dist[src][v] && candidate_nexthop < next[src][v])) {
-                        dist[src][v] = new_dist;
-                        prev[src][v] = u;
-                        next[src][v] = candidate_nexthop;
-                    }
-                }
-            }
-        }
-    }
-};
+#include "distvec.hpp"
+#include "server.hpp"
 
 int main(int argc, char **argv) {
-    if (argc != 4) {
-        printf("Usage: ./DistanceVector topofile messagefile changesfile\n");
+    RouterOptions opts;
+    int arg = parseOptions(argc, argv, opts);
+    bool use_worklist = opts.engine == NULL || strcmp(opts.engine, "spfa") == 0;
+    if (arg == -1 || opts.incremental || opts.heap != NULL || opts.areas != NULL || argc - arg != 3 ||
+        (!use_worklist && strcmp(opts.engine, "bellman-ford") != 0) ||
+        (opts.tables != NULL && opts.save_snapshot != NULL) || (opts.ecmp && (opts.tables != NULL || opts.delta)) ||
+        (opts.compact && (opts.tables != NULL || opts.ecmp || opts.delta || opts.save_snapshot != NULL ||
+                          opts.load_snapshot != NULL))) {
+        printf("Usage: ./DistanceVector [-j threads] [--engine spfa|bellman-ford] [--stats] [--delta] [--quiet] [--save-snapshot file] [--load-snapshot file] [--batch] [--serve unix:path|tcp:[host:]port] [--tables id,...|none] [--ecmp] [--compact] [--profile file|- [--profile-epochs]] topofile messagefile changesfile\n");
+        return -1;
+    }
+    if (opts.profile != NULL && !PROFILE_ENABLED) {
+        printf("--profile needs a build with instrumentation, run make clean && make INSTRUMENT=1\n");
         return -1;
     }
+    ThreadPool pool(opts.threads);
 
-    // Parse topology file
-    DistanceVector router(argv[1], argv[2]);
+    // Parse topology file, or restore the routing state saved for it
+    DistanceVector router(argv[arg], argv[arg + 1], use_worklist, opts.load_snapshot, opts.compact);
+    if (opts.load_snapshot != NULL && !router.isRestored()) {
+        fprintf(stderr, "[*] Snapshot %s cannot be used with %s, recomputing\n", opts.load_snapshot, argv[arg]);
+    }
+    if (opts.tables != NULL && !router.selectTables(opts.tables)) {
+        printf("Invalid table list %s\n", opts.tables);
+        return -1;
+    }
 
-    // Open the changes file
+    // Read the changes file
     // File format: <ID of a node> <ID of another node> <cost of the link between them>
-    FILE *fp = fopen(argv[3], "r");
-    if (fp == NULL) {
-        printf("Error opening file %s\n", argv[3]);
+    vector<vector<Change>> epochs;
+    if (!readChangeEpochs(argv[arg + 2], opts, epochs)) {
+        printf("Error opening file %s\n", argv[arg + 2]);
         return -1;
     }
-    FILE *fpOut;
-    fpOut = fopen("output.txt", "w");
-    if (fpOut == NULL) {
+    int fdOut = open("output.txt", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fdOut == -1) {
         printf("Error opening file output.txt\n");
-        fclose(fp);
         return -1;
     }
+    OutputBuffer out(fdOut);
+    OutputBuffer stdoutBuffer(STDOUT_FILENO);
+    OutputBuffer *console = opts.quiet ? NULL : &stdoutBuffer;
 
-    int u = -1;
-    int v = -1;
-    int w = -1;
-    do {
-        if (u != -1 && v != -1 && w != -1) {
-            // Update the edge in the graph
-            router.updateEdge(u, v, w);
+    // Apply the changes coming before an epoch and bring the tables up to date
+    auto update = [&](const vector<Change> &changes, int epoch) {
+        // Update the edges in the graph, dropping the cached rows they affect in lazy mode
+        for (auto &change : changes) {
+            router.updateEdge(change.u, change.v, change.w);
         }
-        // Run Bellman-Ford algorithm for each node
-        for (int i = 1; i <= router.getNumNodes(); i++) {
-            if (!router.hasInput(i)) {
-                // Skip nodes that are not in the topology
-                continue;
-            }
-            router.calculatePaths(i);
+        // Run Bellman-Ford algorithm for each node, or only for the selected tables and message sources
+        router.resetCounters();
+        if (router.isLazy()) {
+            PROFILE_PHASE(PHASE_PATHS);
+            router.calculateNeededRows(pool);
+        } else if (epoch > 0 || !router.isRestored()) {
+            PROFILE_PHASE(PHASE_PATHS);
+            router.calculateAllPaths(pool);
+        }
+        if (opts.ecmp) {
+            // Gather the equal-cost next hops out of the complete tables
+            PROFILE_PHASE(PHASE_TABLES);
+            router.calculateEcmp(pool);
+        }
+    };
+
+    // Epoch 0 is the initial topology, epoch k comes after the k-th change (or batch of changes)
+    vector<Change> no_changes;
+    for (int epoch = 0; epoch <= epochs.size(); epoch++) {
+        update((epoch > 0) ? epochs[epoch - 1] : no_changes, epoch);
+        if (epoch == 0 && opts.save_snapshot != NULL && !router.saveSnapshot(opts.save_snapshot, argv[arg])) {
+            fprintf(stderr, "[*] Could not save snapshot %s\n", opts.save_snapshot);
         }
-        for (int i = 1; i <= router.getNumNodes(); i++) {
-            if (!router.hasInput(i)) {
-                // Skip nodes that are not in the topology
-                continue;
+        if (opts.stats) {
+            fprintf(stderr, "[*] Bellman-Ford: %lld passes, %lld relaxations over %d sources\n", router.getPasses(),
+                    router.getRelaxations(), router.getNumNodes());
+        }
+        if (opts.delta) {
+            out.putString("epoch ");
+            out.putInt(epoch);
+            out.putChar('\n');
+        }
+        // Print in node order, so the output does not depend on the number of threads
+        {
+            PROFILE_PHASE(PHASE_OUTPUT);
+            for (int i = 0; i < router.getNumNodes(); i++) {
+                if (!router.isTableSelected(i)) continue;
+                // Comment out the following line because we compute the nexthop directly in calculatePaths
+                // router.buildForwardingTable(i);
+                if (opts.delta) {
+                    router.writeForwardingTable(i, NULL, console);
+                    router.writeForwardingTableDelta(i, &out);
+                } else {
+                    router.writeForwardingTable(i, &out, console);
+                }
             }
-            // Comment out the following line because we compute the nexthop directly in calculatePaths
-            // router.buildForwardingTable(i);
-            router.printForwardingTable(i);
-            router.writeForwardingTable(i, fpOut);
+            router.writeMessages(&out, console);
+        }
+        if (opts.stats && opts.ecmp) {
+            long long multipath, next_hops;
+            router.countEcmpRoutes(multipath, next_hops);
+            fprintf(stderr, "[*] Epoch %d: %lld routes with several next hops, %lld next hops in all\n", epoch,
+                    multipath, next_hops);
         }
-        for (int i = 0; i < router.getNumMessages(); i++) {
-            router.printMessage(i);
-            router.writeMessage(i, fpOut);
+        if (opts.stats && router.isLazy()) {
+            fprintf(stderr, "[*] Epoch %d: computed %d of %d rows\n", epoch, router.getRowsComputed(),
+                    router.getNumNodes());
         }
-    } while (fscanf(fp, "%d %d %d", &u, &v, &w) != EOF);
+        PROFILE_EPOCH();
+    }
 
-    fclose(fp);
-    fclose(fpOut);
+    {
+        PROFILE_PHASE(PHASE_OUTPUT);
+        out.flush();
+    }
+    close(fdOut);
+    if (opts.stats) {
+        fprintf(stderr, "[*] Tables %.1f MB, peak RSS %.1f MB\n", router.getTableMB(), peakRssMB());
+    }
 
+    if (opts.serve != NULL) {
+        // Keep the tables resident and answer queries, each link change being an epoch of its own
+        RouteServer server(router, [&](const Change &change) { update({change}, 1); });
+        if (!server.run(opts.serve)) {
+            printf("Cannot serve on %s\n", opts.serve);
+            return -1;
+        }
+    }
+
+    if (opts.profile != NULL && !PROFILE_REPORT(opts.profile, "distvec", opts.threads, router.getNumNodes(),
+                                                router.getNumLinks(), opts.profile_epochs)) {
+        fprintf(stderr, "[*] Could not write profile %s\n", opts.profile);
+    }
     return 0;
 }
@@ -0,0 +1,137 @@
+#ifndef DISTVEC_HPP
+#define DISTVEC_HPP
+
+#include <atomic>
+
+#include "route.hpp"
+
+class DistanceVector : public BaseRouter {
+   public:
+    DistanceVector(const char *topofile, const char *messagefile, bool use_worklist, const char *snapshot = NULL,
+                   bool compact = false)
+        : BaseRouter(topofile, messagefile, snapshot, "distvec", compact), use_worklist(use_worklist) {}
+    void calculatePaths(int src) override {
+        int *d = distRow(src);
+        int *p = prevRow(src);
+        int *nh = nextRow(src);
+
+        // Initialize distances and previous nodes
+        fill(d, d + num_nodes, INT_MAX);
+        fill(p, p + num_nodes, -1);
+        fill(nh, nh + num_nodes, -1);
+
+        d[src] = 0;
+        nh[src] = src;
+        PROFILE_COUNT(COUNT_SOURCES, 1);
+
+        if (use_worklist) {
+            relaxWorklist(src);
+            return;
+        }
+
+        // |V| - 1 iterations
+        long long relaxed = 0;
+        for (int i = 1; i <= num_nodes - 1; i++) {
+            for (int u = 0; u < num_nodes; u++) {
+                if (d[u] == INT_MAX) continue;  // Skip unreachable nodes
+
+                int nexthop_u = (u == src) ? -1 : nh[u];
+                relaxed += g.end(u) - g.begin(u);
+
+                for (int e = g.begin(u); e < g.end(u); e++) {
+                    int v = g.neighbor(e);
+                    int w = g.weight(e);
+                    int new_dist = d[u] + w;
+
+                    int candidate_nexthop = (u == src) ? v : nexthop_u;
+
+                    if (new_dist < d[v] || (new_dist == d[v] && candidate_nexthop < nh[v])) {
+                        d[v] = new_dist;
+                        p[v] = u;
+                        nh[v] = candidate_nexthop;
+                    }
+                }
+            }
+        }
+        passes += max(num_nodes - 1, 0);
+        relaxations += relaxed;
+        PROFILE_COUNT(COUNT_RELAXATIONS, relaxed);
+    }
+
+    // Reset the pass and relaxation counters summed over all sources
+    void resetCounters() {
+        passes = 0;
+        relaxations = 0;
+        negative_cycles = 0;
+    }
+    long long getPasses() { return passes; }
+    long long getRelaxations() { return relaxations; }
+    int getNegativeCycles() { return negative_cycles; }
+
+   private:
+    bool use_worklist;  // Use the queue-based engine instead of |V| - 1 full passes
+    atomic<long long> passes{0};
+    atomic<long long> relaxations{0};
+    atomic<int> negative_cycles{0};
+
+    /*
+     * Queue-based Bellman-Ford (SPFA).
+     * Only the links out of nodes whose distance or next hop changed in the previous
+     * pass are relaxed again, and the loop ends as soon as nothing changes.
+     * A node entering the queue num_nodes times means a negative cycle is reachable.
+     */
+    void relaxWorklist(int src) {
+        int *d = distRow(src);
+        int *p = prevRow(src);
+        int *nh = nextRow(src);
+
+        vector<int> queue = {src};
+        vector<int> next_queue;
+        vector<char> queued(num_nodes, 0);
+        vector<int> enqueue_count(num_nodes, 0);
+        queued[src] = 1;
+
+        long long num_passes = 0;
+        long long relaxed = 0;
+        while (!queue.empty()) {
+            num_passes++;
+            for (int u : queue) {
+                queued[u] = 0;
+                int nexthop_u = (u == src) ? -1 : nh[u];
+                relaxed += g.end(u) - g.begin(u);
+
+                for (int e = g.begin(u); e < g.end(u); e++) {
+                    int v = g.neighbor(e);
+                    int new_dist = d[u] + g.weight(e);
+                    int candidate_nexthop = (u == src) ? v : nexthop_u;
+
+                    // Same tie-break as the full passes: keep the lowest next hop on equal cost
+                    if (new_dist < d[v] || (new_dist == d[v] && candidate_nexthop < nh[v])) {
+                        d[v] = new_dist;
+                        p[v] = u;
+                        nh[v] = candidate_nexthop;
+                        if (!queued[v]) {
+                            queued[v] = 1;
+                            next_queue.push_back(v);
+                            if (++enqueue_count[v] >= num_nodes) {
+                                fprintf(stderr, "Negative cycle reachable from node %d\n", node_id[src]);
+                                negative_cycles++;
+                                passes += num_passes;
+                                relaxations += relaxed;
+                                PROFILE_COUNT(COUNT_RELAXATIONS, relaxed);
+                                return;
+                            }
+                        }
+                    }
+                }
+            }
+            queue.swap(next_queue);
+            next_queue.clear();
+        }
+        passes += num_passes;
+        relaxations += relaxed;
+        PROFILE_COUNT(COUNT_RELAXATIONS, relaxed);
+    }
+};
+
+#endif
@@ -0,0 +1,337 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#include "distvec.hpp"
+
+// One message between neighbors: the advertised cost of every destination that changed
+struct RouteUpdate {
+    int from;                        // Index of the sending node
+    vector<pair<int, int>> entries;  // {destination, advertised cost}
+};
+
+/*
+ * One simulated router. It only knows the cost of its own links, the vectors its
+ * neighbors advertised to it and its own distance vector, and it talks to its
+ * neighbors only through their inboxes.
+ */
+struct RouterNode {
+    vector<int> neighbors;      // Neighbor indices in increasing ID order
+    vector<int> link_cost;      // Cost of the cheapest link to each neighbor
+    vector<vector<int>> heard;  // Last vector advertised by each neighbor
+    vector<int> full_update;    // Neighbors that need our whole vector (new links)
+    bool links_changed;         // A link cost changed, so every destination must be recomputed
+    vector<int> cost;           // Own distance vector
+    vector<int> nexthop;        // Own next hop for each destination
+    vector<RouteUpdate> inbox[2];  // Messages delivered in even and odd rounds
+    mutex inbox_lock;
+};
+
+/*
+ * Distance vector routing as the routers would actually run it: every node is an
+ * actor, and rounds are synchronous, so a message sent in round r is read in round
+ * r + 1. Updates are triggered: a node only sends the destinations whose advertised
+ * cost changed. With split horizon and poisoned reverse, a route is advertised back
+ * to its next hop as infinity. Because updates are deltas, the route has to be
+ * withdrawn from the next hop explicitly, so plain split horizon sends the same
+ * messages as poisoned reverse here. Costs above the total cost of all links
+ * count as infinity, which bounds count-to-infinity when poisoning is off.
+ */
+class DistanceVectorSim : public BaseRouter {
+   public:
+    DistanceVectorSim(const char *topofile, const char *messagefile, bool poison)
+        : BaseRouter(topofile, messagefile), nodes(num_nodes), poison(poison) {
+        for (int x = 0; x < num_nodes; x++) {
+            nodes[x].cost.assign(num_nodes, INT_MAX);
+            nodes[x].nexthop.assign(num_nodes, -1);
+            nodes[x].cost[x] = 0;
+            nodes[x].nexthop[x] = x;
+            refreshLinks(x);
+        }
+    }
+
+    // Copy the converged vector of the source into the routing tables
+    void calculatePaths(int src) override {
+        copy(nodes[src].cost.begin(), nodes[src].cost.end(), distRow(src));
+        copy(nodes[src].nexthop.begin(), nodes[src].nexthop.end(), nextRow(src));
+    }
+
+    // Change a link, only its two ends notice it
+    void changeLink(int u, int v, int w) {
+        updateEdge(u, v, w);
+        if (getIndex(u) == -1 || getIndex(v) == -1) {
+            return;
+        }
+        refreshLinks(getIndex(u));
+        refreshLinks(getIndex(v));
+    }
+
+    // Run rounds until no message is in flight, one partition of the nodes per worker
+    void converge(ThreadPool &pool) {
+        long long total = 0;
+        for (int x = 0; x < num_nodes; x++) {
+            for (int e = g.begin(x); e < g.end(x); e++) {
+                total += g.weight(e);
+            }
+        }
+        infinity = (int)min(total / 2 + 1, (long long)INT_MAX);
+
+        rounds = 0;
+        messages = 0;
+        entries = 0;
+        int partitions = pool.size();
+        while (true) {
+            atomic<long long> sent{0};
+            atomic<long long> sent_entries{0};
+            pool.parallelFor(partitions, [&](int part) {
+                long long part_sent = 0;
+                long long part_entries = 0;
+                int first = (long long)num_nodes * part / partitions;
+                int last = (long long)num_nodes * (part + 1) / partitions;
+                for (int x = first; x < last; x++) {
+                    runNode(x, part_sent, part_entries);
+                }
+                sent += part_sent;
+                sent_entries += part_entries;
+            });
+            if (sent == 0) {
+                break;
+            }
+            round++;
+            rounds++;
+            messages += sent;
+            entries += sent_entries;
+        }
+    }
+
+    int getRounds() { return rounds; }
+    long long getMessages() { return messages; }
+    long long getEntries() { return entries; }
+
+   private:
+    vector<RouterNode> nodes;
+    bool poison;       // Advertise routes back to their next hop as infinity
+    int infinity;      // Costs at or above this are unreachable
+    int round = 0;     // Current round, selects the inbox to read
+    int rounds;        // Rounds with messages in the last converge
+    long long messages;  // Messages sent in the last converge
+    long long entries;   // Vector entries carried by those messages
+
+    // Re-read the links of x from the graph, keeping what the remaining neighbors advertised
+    void refreshLinks(int x) {
+        RouterNode &node = nodes[x];
+        vector<int> neighbors;
+        vector<int> link_cost;
+        for (int e = g.begin(x); e < g.end(x); e++) {
+            neighbors.push_back(g.neighbor(e));
+        }
+        sort(neighbors.begin(), neighbors.end());
+        neighbors.erase(unique(neighbors.begin(), neighbors.end()), neighbors.end());
+
+        vector<vector<int>> heard(neighbors.size());
+        for (int k = 0; k < neighbors.size(); k++) {
+            int n = neighbors[k];
+            link_cost.push_back(g.getWeight(x, n));
+            auto it = lower_bound(node.neighbors.begin(), node.neighbors.end(), n);
+            if (it != node.neighbors.end() && *it == n) {
+                heard[k].swap(node.heard[it - node.neighbors.begin()]);
+            } else {
+                heard[k].assign(num_nodes, INT_MAX);
+                node.full_update.push_back(n);
+            }
+        }
+        node.neighbors.swap(neighbors);
+        node.link_cost.swap(link_cost);
+        node.heard.swap(heard);
+        node.links_changed = true;
+    }
+
+    // Cost of dest as advertised by x to its neighbor n
+    int advertised(int x, int n, int cost, int nexthop) {
+        if (cost == INT_MAX || (poison && nexthop == n && n != x)) {
+            return INT_MAX;
+        }
+        return cost;
+    }
+
+    // One round of node x: read the inbox, recompute the vector and send the changes
+    void runNode(int x, long long &sent, long long &sent_entries) {
+        RouterNode &node = nodes[x];
+        vector<RouteUpdate> &inbox = node.inbox[round & 1];
+        if (inbox.empty() && !node.links_changed && node.full_update.empty()) {
+            return;
+        }
+
+        vector<int> dirty;
+        for (auto &update : inbox) {
+            auto it = lower_bound(node.neighbors.begin(), node.neighbors.end(), update.from);
+            if (it == node.neighbors.end() || *it != update.from) {
+                continue;  // The link went down while the message was in flight
+            }
+            vector<int> &heard = node.heard[it - node.neighbors.begin()];
+            for (auto &entry : update.entries) {
+                heard[entry.first] = entry.second;
+                dirty.push_back(entry.first);
+            }
+        }
+        inbox.clear();
+        if (node.links_changed) {
+            dirty.resize(num_nodes);
+            for (int d = 0; d < num_nodes; d++) {
+                dirty[d] = d;
+            }
+            node.links_changed = false;
+        } else {
+            sort(dirty.begin(), dirty.end());
+            dirty.erase(unique(dirty.begin(), dirty.end()), dirty.end());
+        }
+
+        // Bellman-Ford equation over the neighbors, the lowest neighbor ID wins ties
+        vector<int> changed;
+        vector<pair<int, int>> old_routes;
+        for (int d : dirty) {
+            if (d == x) continue;
+            long long best = INT_MAX;
+            int best_hop = -1;
+            for (int k = 0; k < node.neighbors.size(); k++) {
+                if (node.heard[k][d] == INT_MAX) continue;
+                long long candidate = (long long)node.link_cost[k] + node.heard[k][d];
+                if (candidate < best) {
+                    best = candidate;
+                    best_hop = node.neighbors[k];
+                }
+            }
+            if (best >= infinity) {
+                best = INT_MAX;
+                best_hop = -1;
+            }
+            if (best != node.cost[d] || best_hop != node.nexthop[d]) {
+                changed.push_back(d);
+                old_routes.push_back({node.cost[d], node.nexthop[d]});
+                node.cost[d] = best;
+                node.nexthop[d] = best_hop;
+            }
+        }
+
+        // Triggered updates: send each neighbor the entries whose advertised cost changed
+        for (int n : node.neighbors) {
+            RouteUpdate update;
+            update.from = x;
+            if (find(node.full_update.begin(), node.full_update.end(), n) != node.full_update.end()) {
+                for (int d = 0; d < num_nodes; d++) {
+                    int cost = advertised(x, n, node.cost[d], node.nexthop[d]);
+                    if (cost != INT_MAX) update.entries.push_back({d, cost});
+                }
+            } else {
+                for (int i = 0; i < changed.size(); i++) {
+                    int d = changed[i];
+                    int before = advertised(x, n, old_routes[i].first, old_routes[i].second);
+                    int after = advertised(x, n, node.cost[d], node.nexthop[d]);
+                    if (before != after) update.entries.push_back({d, after});
+                }
+            }
+            if (update.entries.empty()) continue;
+
+            sent++;
+            sent_entries += update.entries.size();
+            RouterNode &neighbor = nodes[n];
+            lock_guard<mutex> guard(neighbor.inbox_lock);
+            neighbor.inbox[(round + 1) & 1].push_back(move(update));
+        }
+        node.full_update.clear();
+    }
+};
+
+// Count the (source, destination) pairs whose cost or next hop differ between the two routers
+static long long countMismatches(DistanceVectorSim &sim, DistanceVector &ref) {
+    long long mismatches = 0;
+    for (int src = 0; src < sim.getNumNodes(); src++) {
+        for (int dest = 0; dest < sim.getNumNodes(); dest++) {
+            if (sim.getCost(src, dest) != ref.getCost(src, dest) ||
+                (sim.getCost(src, dest) != INT_MAX && sim.getNextHop(src, dest) != ref.getNextHop(src, dest))) {
+                mismatches++;
+            }
+        }
+    }
+    return mismatches;
+}
+
+int main(int argc, char **argv) {
+    RouterOptions opts;
+    int arg = parseOptions(argc, argv, opts);
+    if (arg == -1 || opts.incremental || opts.engine != NULL || opts.save_snapshot != NULL ||
+        opts.load_snapshot != NULL || opts.tables != NULL || opts.heap != NULL || opts.serve != NULL || opts.ecmp ||
+        opts.areas != NULL || opts.compact || argc - arg != 3) {
+        printf("Usage: ./dvsim [-j threads] [--no-poison] [--verify] [--delta] [--quiet] [--batch] topofile messagefile changesfile\n");
+        return -1;
+    }
+    ThreadPool pool(opts.threads);
+
+    // Parse topology file
+    DistanceVectorSim router(argv[arg], argv[arg + 1], opts.poison);
+    DistanceVector *reference = NULL;
+    if (opts.verify) {
+        reference = new DistanceVector(argv[arg], argv[arg + 1], true);
+    }
+
+    // Read the changes file
+    // File format: <ID of a node> <ID of another node> <cost of the link between them>
+    vector<vector<Change>> epochs;
+    if (!readChangeEpochs(argv[arg + 2], opts, epochs)) {
+        printf("Error opening file %s\n", argv[arg + 2]);
+        return -1;
+    }
+    int fdOut = open("output.txt", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fdOut == -1) {
+        printf("Error opening file output.txt\n");
+        return -1;
+    }
+    OutputBuffer out(fdOut);
+    OutputBuffer stdoutBuffer(STDOUT_FILENO);
+    OutputBuffer *console = opts.quiet ? NULL : &stdoutBuffer;
+
+    // Epoch 0 is the initial topology, epoch k comes after the k-th change (or batch of changes)
+    vector<Change> no_changes;
+    for (int epoch = 0; epoch <= epochs.size(); epoch++) {
+        const vector<Change> &changes = (epoch > 0) ? epochs[epoch - 1] : no_changes;
+        // Only the two ends of each link see the change, the rest learn it from messages
+        for (auto &change : changes) {
+            router.changeLink(change.u, change.v, change.w);
+            if (reference != NULL) {
+                reference->updateEdge(change.u, change.v, change.w);
+            }
+        }
+        router.converge(pool);
+        router.calculateAllPaths(pool);
+        fprintf(stderr, "[*] Converged in %d rounds, %lld messages, %lld entries\n", router.getRounds(),
+                router.getMessages(), router.getEntries());
+        if (reference != NULL) {
+            reference->calculateAllPaths(pool);
+            fprintf(stderr, "[*] %lld entries differ from distvec\n", countMismatches(router, *reference));
+        }
+
+        if (opts.delta) {
+            out.putString("epoch ");
+            out.putInt(epoch);
+            out.putChar('\n');
+        }
+        for (int i = 0; i < router.getNumNodes(); i++) {
+            if (opts.delta) {
+                router.writeForwardingTable(i, NULL, console);
+                router.writeForwardingTableDelta(i, &out);
+            } else {
+                router.writeForwardingTable(i, &out, console);
+            }
+        }
+        router.writeMessages(&out, console);
+    }
+
+    delete reference;
+    out.flush();
+    close(fdOut);
+
+    return 0;
+}
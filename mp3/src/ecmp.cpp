@@ -0,0 +1,133 @@
+/*
+ * Equal-cost multipath (ECMP) forwarding tables.
+ *
+ * A link src -> n of cost w is an equal-cost next hop towards dest when
+ * w + dist(n, dest) == dist(src, dest). The set of them for one (src, dest) is a
+ * bitset over the link slots of src in the graph, ecmp_words[src] 64-bit words
+ * long, so a node with up to 64 links uses a single word per destination. The
+ * bitsets of src start at ecmp[ecmp_row[src]], one per destination in order.
+ *
+ * Only links of positive cost are taken besides the single next hop in next,
+ * so every hop either lowers the remaining cost or follows the canonical route,
+ * and no walk can go around a zero-cost loop.
+ */
+#include "route.hpp"
+
+/*
+ * Lay out the bitsets for the current degrees, and build the tables of every source.
+ * Must follow the computation of dist and next for every source.
+ */
+void BaseRouter::calculateEcmp(ThreadPool &pool) {
+    ecmp_row.resize(num_nodes + 1);
+    ecmp_words.resize(num_nodes);
+    size_t total = 0;
+    for (int src = 0; src < num_nodes; src++) {
+        ecmp_row[src] = total;
+        ecmp_words[src] = (g.getDegree(src) + 63) / 64;
+        total += (size_t)ecmp_words[src] * num_nodes;
+    }
+    ecmp_row[num_nodes] = total;
+    ecmp.assign(total, 0);
+    pool.parallelFor(num_nodes, [this](int src) { buildEcmpTable(src); });
+}
+
+// Set the bits of every equal-cost next hop of src, walking the rows of its neighbors one after the other
+void BaseRouter::buildEcmpTable(int src) {
+    int words = ecmp_words[src];
+    uint64_t *bits = &ecmp[ecmp_row[src]];
+    int *d = distRow(src);
+    int *nh = nextRow(src);
+    for (int e = g.begin(src); e < g.end(src); e++) {
+        int n = g.neighbor(e);
+        long long w = g.weight(e);
+        int slot = e - g.begin(src);
+        uint64_t mask = 1ULL << (slot % 64);
+        uint64_t *word = bits + slot / 64;
+        int *dn = distRow(n);
+        for (int dest = 0; dest < num_nodes; dest++) {
+            if (dest == src || d[dest] == INT_MAX) continue;
+            if ((w > 0 && dn[dest] != INT_MAX && w + dn[dest] == d[dest]) || nh[dest] == n) {
+                word[(size_t)dest * words] |= mask;
+            }
+        }
+    }
+}
+
+// Get the equal-cost next hops from src to dest into hops, in increasing node order
+void BaseRouter::getEcmpNextHops(int src, int dest, vector<int> &hops) {
+    hops.clear();
+    int words = ecmp_words[src];
+    const uint64_t *bits = &ecmp[ecmp_row[src] + (size_t)dest * words];
+    for (int k = 0; k < words; k++) {
+        for (uint64_t b = bits[k]; b != 0; b &= b - 1) {
+            hops.push_back(g.neighbor(g.begin(src) + k * 64 + __builtin_ctzll(b)));
+        }
+    }
+    sort(hops.begin(), hops.end());
+}
+
+/*
+ * Get the path of a flow from src to dest into path, like getPath.
+ * At every node the flow takes one of the equal-cost next hops picked by hashing
+ * flow with the node, so one flow always takes the same path while different
+ * flows spread over all of them.
+ */
+void BaseRouter::getEcmpPath(int src, int dest, uint64_t flow, vector<int> &path) {
+    static thread_local vector<int> hops;
+    path.clear();
+    if (src == -1 || dest == -1 || distRow(src)[dest] == INT_MAX) {
+        return;
+    }
+    int cur = src;
+    while (cur != dest) {
+        if (path.size() == num_nodes) {
+            getPath(src, dest, path);  // Went around a loop, only zero-cost links can cause one
+            return;
+        }
+        path.push_back(cur);
+        getEcmpNextHops(cur, dest, hops);
+        if (hops.empty()) {
+            cur = nextRow(cur)[dest];
+            continue;
+        }
+        // splitmix64 finalizer, so consecutive node indices give unrelated picks
+        uint64_t h = flow ^ ((uint64_t)node_id[cur] * 0x9E3779B97F4A7C15ULL);
+        h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+        h ^= h >> 31;
+        cur = hops[h % hops.size()];
+    }
+}
+
+// Hash of the source, destination and text of a message, the flow key of getEcmpPath
+uint64_t BaseRouter::flowHash(int index) {
+    Message &msg = messages[index];
+    uint64_t hash = 14695981039346656037ULL;
+    auto mix = [&](const char *p, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            hash = (hash ^ (unsigned char)p[i]) * 1099511628211ULL;
+        }
+    };
+    mix((const char *)&msg.src, sizeof(msg.src));
+    mix((const char *)&msg.dest, sizeof(msg.dest));
+    mix(msg.message.data(), msg.message.size());
+    return hash;
+}
+
+// Count the reachable (src, dest) pairs with more than one next hop, and the next hops of all pairs
+void BaseRouter::countEcmpRoutes(long long &multipath, long long &next_hops) {
+    multipath = 0;
+    next_hops = 0;
+    for (int src = 0; src < num_nodes; src++) {
+        int words = ecmp_words[src];
+        const uint64_t *bits = &ecmp[ecmp_row[src]];
+        for (int dest = 0; dest < num_nodes; dest++) {
+            int count = 0;
+            for (int k = 0; k < words; k++) {
+                count += __builtin_popcountll(bits[(size_t)dest * words + k]);
+            }
+            next_hops += count;
+            if (count > 1) multipath++;
+        }
+    }
+}
@@ -0,0 +1,130 @@
+#include "graph.hpp"
+
+#include <limits.h>
+
+#include <algorithm>
+
+// Spare room left at the end of every row when the arrays are (re)built
+static int spareRoom(int degree) {
+    return degree / 4 + 2;
+}
+
+// Build the CSR arrays for n nodes from a list of links between dense indices
+void Graph::build(int n, const vector<Link>& links) {
+    num_nodes = n;
+    num_edges = 0;
+    min_weight = 0;
+    max_weight = 0;
+    degree.assign(n, 0);
+    for (auto& link : links) {
+        degree[link.u]++;
+        degree[link.v]++;
+    }
+
+    offset.assign(n + 1, 0);
+    for (int u = 0; u < n; u++) {
+        offset[u + 1] = offset[u] + degree[u] + spareRoom(degree[u]);
+    }
+    nbr.assign(offset[n], -1);
+    wt.assign(offset[n], 0);
+
+    degree.assign(n, 0);
+    for (auto& link : links) {
+        addEdge(link.u, link.v, link.w);
+    }
+}
+
+// Take over arrays saved from getOffsets/getDegrees/getNeighbors/getWeights
+void Graph::restore(int n, int edges, vector<int>& offsets, vector<int>& degrees, vector<int>& neighbors,
+                    vector<int>& weights) {
+    num_nodes = n;
+    num_edges = edges;
+    offset.swap(offsets);
+    degree.swap(degrees);
+    nbr.swap(neighbors);
+    wt.swap(weights);
+    min_weight = 0;
+    max_weight = 0;
+    for (int u = 0; u < n; u++) {
+        for (int e = begin(u); e < end(u); e++) {
+            min_weight = min(min_weight, wt[e]);
+            max_weight = max(max_weight, wt[e]);
+        }
+    }
+}
+
+// Add a link between u and v with cost w
+void Graph::addEdge(int u, int v, int w) {
+    insert(u, v, w);
+    insert(v, u, w);
+    num_edges++;
+}
+
+// Remove one link between u and v
+void Graph::removeEdge(int u, int v) {
+    for (int e = begin(u); e < end(u); e++) {
+        if (nbr[e] == v) {
+            erase(u, v);
+            erase(v, u);
+            num_edges--;
+            return;
+        }
+    }
+}
+
+// Get the cost of the cheapest link between u and v, INT_MAX if they are not connected
+int Graph::getWeight(int u, int v) const {
+    int w = INT_MAX;
+    for (int e = begin(u); e < end(u); e++) {
+        if (nbr[e] == v && wt[e] < w) {
+            w = wt[e];
+        }
+    }
+    return w;
+}
+
+// Append v to the row of u, growing the arrays if the row is full
+void Graph::insert(int u, int v, int w) {
+    if (offset[u] + degree[u] == offset[u + 1]) {
+        grow(u);
+    }
+    int e = offset[u] + degree[u];
+    nbr[e] = v;
+    wt[e] = w;
+    degree[u]++;
+    min_weight = min(min_weight, w);
+    max_weight = max(max_weight, w);
+}
+
+// Remove the first v from the row of u by moving the last link into its slot
+void Graph::erase(int u, int v) {
+    for (int e = begin(u); e < end(u); e++) {
+        if (nbr[e] == v) {
+            int last = end(u) - 1;
+            nbr[e] = nbr[last];
+            wt[e] = wt[last];
+            degree[u]--;
+            return;
+        }
+    }
+}
+
+// Rebuild the arrays with fresh spare room in every row and twice the room in row u
+void Graph::grow(int u) {
+    vector<int> new_offset(num_nodes + 1, 0);
+    for (int x = 0; x < num_nodes; x++) {
+        int room = (x == u) ? degree[x] + 1 : spareRoom(degree[x]);
+        new_offset[x + 1] = new_offset[x] + degree[x] + room;
+    }
+    vector<int> new_nbr(new_offset[num_nodes], -1);
+    vector<int> new_wt(new_offset[num_nodes], 0);
+    for (int x = 0; x < num_nodes; x++) {
+        for (int i = 0; i < degree[x]; i++) {
+            new_nbr[new_offset[x] + i] = nbr[offset[x] + i];
+            new_wt[new_offset[x] + i] = wt[offset[x] + i];
+        }
+    }
+    offset.swap(new_offset);
+    nbr.swap(new_nbr);
+    wt.swap(new_wt);
+}
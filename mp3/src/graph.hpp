@@ -0,0 +1,65 @@
+#ifndef GRAPH_HPP
+#define GRAPH_HPP
+
+#include <vector>
+
+using namespace std;
+
+struct Link {
+    int u;  // One end of the link
+    int v;  // The other end of the link
+    int w;  // Cost of the link
+};
+
+/*
+ * Undirected graph stored in compressed sparse row form.
+ * The links of node u live in nbr/wt[offset[u], offset[u] + degree[u]), and every
+ * row keeps some spare room up to offset[u + 1], so that links can be added and
+ * removed in place. The arrays are only rebuilt when a row runs out of room.
+ */
+class Graph {
+   public:
+    Graph() : num_nodes(0), num_edges(0), min_weight(0), max_weight(0) {}
+
+    void build(int n, const vector<Link>& links);
+    void addEdge(int u, int v, int w);
+    void removeEdge(int u, int v);
+    int getWeight(int u, int v) const;
+
+    int size() const { return num_nodes; }
+    int numEdges() const { return num_edges; }
+    int getDegree(int u) const { return degree[u]; }
+    // Bounds on the link costs, covering every link added since the graph was built
+    int minWeight() const { return min_weight; }
+    int maxWeight() const { return max_weight; }
+
+    // Iterate over the links of u with: for (int e = g.begin(u); e < g.end(u); e++)
+    int begin(int u) const { return offset[u]; }
+    int end(int u) const { return offset[u] + degree[u]; }
+    int neighbor(int e) const { return nbr[e]; }
+    int weight(int e) const { return wt[e]; }
+
+    // Raw arrays, used to save the graph into a snapshot and to restore it
+    const vector<int>& getOffsets() const { return offset; }
+    const vector<int>& getDegrees() const { return degree; }
+    const vector<int>& getNeighbors() const { return nbr; }
+    const vector<int>& getWeights() const { return wt; }
+    void restore(int n, int edges, vector<int>& offsets, vector<int>& degrees, vector<int>& neighbors,
+                 vector<int>& weights);
+
+   private:
+    int num_nodes;
+    int num_edges;
+    int min_weight;
+    int max_weight;
+    vector<int> offset;  // Start of each row, offset[num_nodes] is the total capacity
+    vector<int> degree;  // Number of links used in each row
+    vector<int> nbr;     // Neighbor of each link
+    vector<int> wt;      // Cost of each link
+
+    void insert(int u, int v, int w);
+    void erase(int u, int v);
+    void grow(int u);
+};
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef HEAP_HPP
+#define HEAP_HPP
+
+#include <functional>
+#include <queue>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Priority queues over (node, key) for Dijkstra with non-negative integer keys.
+ * All of them share the same interface:
+ *   reset(n, max_weight)  empty the queue for nodes 0..n-1 and links of cost at most max_weight
+ *   push(node, key)       insert node, or lower its key if it is already queued
+ *   pop(key)              remove a node with the smallest key and return it, with its key in key
+ *   empty()
+ * BinaryHeap, RadixHeap and BucketQueue do not look for queued nodes on push, so
+ * pop may return a node again with a key that is no longer its distance. Callers
+ * skip those stale entries by comparing the key with the distance.
+ */
+
+// std::priority_queue with lazy deletion, what calculatePaths used originally
+class BinaryHeap {
+   public:
+    void reset(int, int) { pq = decltype(pq)(); }
+    void push(int node, int key) { pq.push({key, node}); }
+    int pop(int& key) {
+        key = pq.top().first;
+        int node = pq.top().second;
+        pq.pop();
+        return node;
+    }
+    bool empty() { return pq.empty(); }
+
+   private:
+    priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> pq;
+};
+
+/*
+ * Radix heap: a key lives in the bucket of the highest bit where it differs from
+ * the last key popped. Keys popped are non-decreasing in Dijkstra, so a bucket
+ * only has to be redistributed when everything below it is empty.
+ */
+class RadixHeap {
+   public:
+    void reset(int, int) {
+        for (auto& bucket : buckets) bucket.clear();
+        last = 0;
+        count = 0;
+    }
+    void push(int node, int key) {
+        buckets[bucketOf((unsigned)key ^ last)].push_back({(unsigned)key, node});
+        count++;
+    }
+    int pop(int& key) {
+        if (buckets[0].empty()) {
+            int i = 1;
+            while (buckets[i].empty()) i++;
+            // Redistribute the first non-empty bucket around its smallest key
+            last = buckets[i][0].first;
+            for (auto& entry : buckets[i]) {
+                if (entry.first < last) last = entry.first;
+            }
+            for (auto& entry : buckets[i]) {
+                buckets[bucketOf(entry.first ^ last)].push_back(entry);
+            }
+            buckets[i].clear();
+        }
+        key = buckets[0].back().first;
+        int node = buckets[0].back().second;
+        buckets[0].pop_back();
+        count--;
+        return node;
+    }
+    bool empty() { return count == 0; }
+
+   private:
+    vector<pair<unsigned, int>> buckets[33];  // {key, node}
+    unsigned last = 0;                         // Last key popped
+    size_t count = 0;
+
+    static int bucketOf(unsigned x) { return x == 0 ? 0 : 32 - __builtin_clz(x); }
+};
+
+/*
+ * Dial's bucket queue: every queued key is within max_weight of the smallest one,
+ * so max_weight + 1 circular buckets of nodes hold each key in its own bucket.
+ */
+class BucketQueue {
+   public:
+    void reset(int, int max_weight) {
+        if (buckets.size() != max_weight + 1) {
+            buckets.assign(max_weight + 1, vector<int>());
+        }
+        for (auto& bucket : buckets) bucket.clear();
+        current = 0;
+        count = 0;
+    }
+    void push(int node, int key) {
+        buckets[key % buckets.size()].push_back(node);
+        count++;
+    }
+    int pop(int& key) {
+        while (buckets[current % buckets.size()].empty()) current++;
+        vector<int>& bucket = buckets[current % buckets.size()];
+        key = current;
+        int node = bucket.back();
+        bucket.pop_back();
+        count--;
+        return node;
+    }
+    bool empty() { return count == 0; }
+
+   private:
+    vector<vector<int>> buckets;
+    int current = 0;  // Smallest key that can still be queued
+    size_t count = 0;
+};
+
+// 4-ary heap indexed by node, pushing a queued node lowers its key in place
+class QuaternaryHeap {
+   public:
+    void reset(int n, int) {
+        heap.clear();
+        pos.assign(n, -1);
+        key_of.resize(n);
+    }
+    void push(int node, int key) {
+        if (pos[node] == -1) {
+            pos[node] = heap.size();
+            heap.push_back(node);
+        } else if (key >= key_of[node]) {
+            return;
+        }
+        key_of[node] = key;
+        siftUp(pos[node]);
+    }
+    int pop(int& key) {
+        int node = heap[0];
+        key = key_of[node];
+        pos[node] = -1;
+        int last = heap.back();
+        heap.pop_back();
+        if (!heap.empty()) {
+            heap[0] = last;
+            pos[last] = 0;
+            siftDown(0);
+        }
+        return node;
+    }
+    bool empty() { return heap.empty(); }
+
+   private:
+    vector<int> heap;    // Queued nodes in heap order
+    vector<int> pos;     // Position of each node in heap, -1 if it is not queued
+    vector<int> key_of;  // Key of each queued node
+
+    void siftUp(int i) {
+        int node = heap[i];
+        while (i > 0) {
+            int parent = (i - 1) / 4;
+            if (key_of[heap[parent]] <= key_of[node]) break;
+            heap[i] = heap[parent];
+            pos[heap[i]] = i;
+            i = parent;
+        }
+        heap[i] = node;
+        pos[node] = i;
+    }
+    void siftDown(int i) {
+        int node = heap[i];
+        int n = heap.size();
+        while (true) {
+            int first = 4 * i + 1;
+            if (first >= n) break;
+            int best = first;
+            int stop = min(first + 4, n);
+            for (int c = first + 1; c < stop; c++) {
+                if (key_of[heap[c]] < key_of[heap[best]]) best = c;
+            }
+            if (key_of[heap[best]] >= key_of[node]) break;
+            heap[i] = heap[best];
+            pos[heap[i]] = i;
+            i = best;
+        }
+        heap[i] = node;
+        pos[node] = i;
+    }
+};
+
+#endif
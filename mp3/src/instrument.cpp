@@ -0,0 +1,113 @@
+#include "instrument.hpp"
+
+#ifdef ROUTE_INSTRUMENT
+
+#include <time.h>
+
+#include <memory>
+#include <mutex>
+
+#include "route.hpp"
+
+static const char *phase_names[NUM_PHASES] = {"parse", "paths", "tables", "output", "write"};
+static const char *counter_names[NUM_COUNTERS] = {"sources",    "relaxations", "heap_pushes",
+                                                  "heap_pops",  "write_calls", "bytes_written"};
+
+// Totals since the start of the run
+struct ProfileTotals {
+    double wall[NUM_PHASES] = {};
+    double cpu[NUM_PHASES] = {};
+    long long counts[NUM_COUNTERS] = {};
+};
+
+static ProfileTotals phases;                             // Phase times, the counters live in thread_counters
+static mutex counters_lock;
+static vector<unique_ptr<long long[]>> thread_counters;  // Counters of every thread that counted something
+static vector<ProfileTotals> epoch_ends;                 // Totals at the end of each epoch
+
+static double clockSeconds(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+ProfileTimer::ProfileTimer(ProfilePhase phase) : phase(phase) {
+    wall = clockSeconds(CLOCK_MONOTONIC);
+    cpu = clockSeconds(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+ProfileTimer::~ProfileTimer() {
+    phases.wall[phase] += clockSeconds(CLOCK_MONOTONIC) - wall;
+    phases.cpu[phase] += clockSeconds(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+}
+
+// Counters of the calling thread, registered on its first call
+long long *profileCounters() {
+    static thread_local long long *counts = NULL;
+    if (counts == NULL) {
+        lock_guard<mutex> lock(counters_lock);
+        thread_counters.emplace_back(new long long[NUM_COUNTERS]());
+        counts = thread_counters.back().get();
+    }
+    return counts;
+}
+
+// Phase times and counters summed over every thread, to be called while the workers are idle
+static ProfileTotals currentTotals() {
+    ProfileTotals totals = phases;
+    lock_guard<mutex> lock(counters_lock);
+    for (auto &counts : thread_counters) {
+        for (int c = 0; c < NUM_COUNTERS; c++) {
+            totals.counts[c] += counts[c];
+        }
+    }
+    return totals;
+}
+
+void profileEpoch() {
+    epoch_ends.push_back(currentTotals());
+}
+
+// Write the phases and counters of end minus start as JSON members
+static void writeTotals(FILE *fp, const ProfileTotals &end, const ProfileTotals &start, const char *indent) {
+    fprintf(fp, "%s\"phases\": {", indent);
+    for (int k = 0; k < NUM_PHASES; k++) {
+        fprintf(fp, "%s\"%s\": {\"wall_s\": %.6f, \"cpu_s\": %.6f}", k > 0 ? ", " : "", phase_names[k],
+                end.wall[k] - start.wall[k], end.cpu[k] - start.cpu[k]);
+    }
+    fprintf(fp, "},\n%s\"counters\": {", indent);
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+        fprintf(fp, "%s\"%s\": %lld", c > 0 ? ", " : "", counter_names[c], end.counts[c] - start.counts[c]);
+    }
+    fprintf(fp, "}");
+}
+
+/*
+ * Write the JSON summary of the run to filename, "-" for stderr: the totals of every
+ * phase and counter, the peak RSS and, if per_epoch is set, the same totals for
+ * every epoch closed by profileEpoch. Return false if the file cannot be written.
+ */
+bool profileReport(const char *filename, const char *program, int threads, int nodes, int links, bool per_epoch) {
+    FILE *fp = (strcmp(filename, "-") == 0) ? stderr : fopen(filename, "w");
+    if (fp == NULL) {
+        return false;
+    }
+    ProfileTotals none;
+    fprintf(fp, "{\n  \"program\": \"%s\", \"threads\": %d, \"nodes\": %d, \"links\": %d, \"epochs\": %zu,\n",
+            program, threads, nodes, links, epoch_ends.size());
+    writeTotals(fp, currentTotals(), none, "  ");
+    fprintf(fp, ",\n  \"peak_rss_mb\": %.1f", peakRssMB());
+    if (per_epoch) {
+        fprintf(fp, ",\n  \"per_epoch\": [");
+        for (size_t k = 0; k < epoch_ends.size(); k++) {
+            fprintf(fp, "%s\n    {\"epoch\": %zu,\n", k > 0 ? "," : "", k);
+            writeTotals(fp, epoch_ends[k], k > 0 ? epoch_ends[k - 1] : none, "     ");
+            fprintf(fp, "}");
+        }
+        fprintf(fp, "\n  ]");
+    }
+    fprintf(fp, "\n}\n");
+    return fp == stderr ? fflush(fp) == 0 : fclose(fp) == 0;
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef INSTRUMENT_HPP
+#define INSTRUMENT_HPP
+
+/*
+ * Instrumentation of the hot paths of linkstate and distvec, compiled in with
+ * make INSTRUMENT=1, which defines ROUTE_INSTRUMENT. Without it every macro below
+ * expands to nothing, and the routers run the same code as before.
+ *
+ *   PROFILE_PHASE(phase)       time the rest of the scope into phase, wall and process CPU time
+ *   PROFILE_COUNT(counter, n)  add n to counter, kept per thread so workers never share it
+ *   PROFILE_EPOCH()            close an epoch, for the breakdown of the summary per epoch
+ *   PROFILE_REPORT(...)        write the JSON summary, see profileReport
+ *
+ * Phases are only timed on the main thread. The write phase is the time spent in
+ * write() by OutputBuffer, so it is part of the output phase around it.
+ */
+enum ProfilePhase { PHASE_PARSE, PHASE_PATHS, PHASE_TABLES, PHASE_OUTPUT, PHASE_WRITE, NUM_PHASES };
+enum ProfileCounter {
+    COUNT_SOURCES,        // Shortest path computations from one source, full or repaired
+    COUNT_RELAXATIONS,    // Links looked at out of a node
+    COUNT_HEAP_PUSHES,
+    COUNT_HEAP_POPS,
+    COUNT_WRITE_CALLS,    // write() calls of OutputBuffer
+    COUNT_BYTES_WRITTEN,
+    NUM_COUNTERS
+};
+
+#ifdef ROUTE_INSTRUMENT
+
+// Adds the time between its construction and its destruction to a phase
+class ProfileTimer {
+   public:
+    explicit ProfileTimer(ProfilePhase phase);
+    ~ProfileTimer();
+
+   private:
+    ProfilePhase phase;
+    double wall;
+    double cpu;
+};
+
+long long* profileCounters();
+void profileEpoch();
+bool profileReport(const char* filename, const char* program, int threads, int nodes, int links, bool per_epoch);
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_PHASE(phase) ProfileTimer PROFILE_CONCAT(profile_timer_, __LINE__)(phase)
+#define PROFILE_COUNT(counter, n) (profileCounters()[counter] += (n))
+#define PROFILE_EPOCH() profileEpoch()
+#define PROFILE_REPORT(filename, program, threads, nodes, links, per_epoch) \
+    profileReport(filename, program, threads, nodes, links, per_epoch)
+#define PROFILE_ENABLED true
+
+#else
+
+#define PROFILE_PHASE(phase) ((void)0)
+#define PROFILE_COUNT(counter, n) ((void)0)
+#define PROFILE_EPOCH() ((void)0)
+#define PROFILE_REPORT(filename, program, threads, nodes, links, per_epoch) false
+#define PROFILE_ENABLED false
+
+#endif
+
+#endif
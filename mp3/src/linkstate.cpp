@@ -1,108 +1,175 @@
-#include "route.hpp"
+#include <fcntl.h>
+#include <unistd.h>
 
-class LinkState : public BaseRouter {
-   public:
-    LinkState(const char *topofile, const char *messagefile) : BaseRouter(topofile, messagefile) {}
-    void calculatePaths(int src) override {
-        // Initialize distances
-        dist[src].clear();
-        prev[src].clear();
-        dist[src].resize(num_nodes + 1, INT_MAX);
-        prev[src].resize(num_nodes + 1, -1);
-
-        dist[src][src] = 0;
-        prev[src][src] = src;
-        vector<bool> visited(num_nodes + 1, false);
-
-        // Priority queue to select the node with the smallest distance
-        priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> pq;
-        pq.push({0, src});  // {distance, node}
-        while (!pq.empty()) {
-            int u = pq.top().second;
-            pq.pop();
-
-            if (visited[u]) continue;
-            visited[u] = true;
-
-            for (auto &edge : g[u]) {
-                int v = edge.first;
-                int w = edge.second;
-                int new_dist = dist[src][u] + w;
-
-                if (new_dist < dist[src][v]) {
-                    dist[src][v] = new_dist;
-                    prev[src][v] = u;
-                    pq.push({dist[src][v], v});
-                }
-                // If there is a tie, choose the lowest node ID
-                else if (new_dist == dist[src][v]) {
-                    if (prev[src][v] == -1 || u < prev[src][v]) {
-                        prev[src][v] = u;
-                        pq.push({dist[src][v], v});
-                    }
-                }
-            }
-        }
-    }
-};
+#include "area.hpp"
+#include "linkstate.hpp"
+#include "server.hpp"
 
 int main(int argc, char **argv) {
-    if (argc != 4) {
-        printf("Usage: ./linkstate topofile messagefile changesfile\n");
+    RouterOptions opts;
+    int arg = parseOptions(argc, argv, opts);
+    bool delta_stepping = opts.engine != NULL && strcmp(opts.engine, "delta-stepping") == 0;
+    if (arg == -1 || argc - arg != 3 || (opts.engine != NULL && !delta_stepping && strcmp(opts.engine, "dijkstra") != 0) ||
+        (opts.tables != NULL && (opts.incremental || opts.save_snapshot != NULL || delta_stepping)) ||
+        (opts.ecmp && (opts.tables != NULL || opts.delta)) ||
+        (opts.areas != NULL && (opts.incremental || opts.engine != NULL || opts.delta || opts.save_snapshot != NULL ||
+                                opts.load_snapshot != NULL || opts.serve != NULL || opts.tables != NULL ||
+                                opts.heap != NULL || opts.ecmp || opts.compact || opts.profile != NULL)) ||
+        (opts.compact && (opts.incremental || delta_stepping || opts.tables != NULL || opts.ecmp || opts.delta ||
+                          opts.save_snapshot != NULL || opts.load_snapshot != NULL))) {
+        printf("Usage: ./linkstate [-i|--incremental] [-j threads] [--engine dijkstra|delta-stepping] [--delta] [--quiet] [--save-snapshot file] [--load-snapshot file] [--batch] [--serve unix:path|tcp:[host:]port] [--tables id,...|none] [--ecmp] [--areas auto[:size]|file] [--compact] [--heap binary|radix|dial|4ary] [--stats] [--profile file|- [--profile-epochs]] topofile messagefile changesfile\n");
+        return -1;
+    }
+    if (opts.profile != NULL && !PROFILE_ENABLED) {
+        printf("--profile needs a build with instrumentation, run make clean && make INSTRUMENT=1\n");
         return -1;
     }
+    if (opts.areas != NULL) {
+        return runAreaRouting(argv[arg], argv[arg + 1], argv[arg + 2], opts);
+    }
+    ThreadPool pool(opts.threads);
 
-    // Parse topology file
-    LinkState router(argv[1], argv[2]);
+    // Parse topology file, or restore the routing state saved for it
+    LinkState router(argv[arg], argv[arg + 1], opts.load_snapshot, opts.compact);
+    if (opts.load_snapshot != NULL && !router.isRestored()) {
+        fprintf(stderr, "[*] Snapshot %s cannot be used with %s, recomputing\n", opts.load_snapshot, argv[arg]);
+    }
+    if (delta_stepping) {
+        // Run one source at a time, each of them spread over the whole pool
+        router.useDeltaStepping(&pool);
+    }
+    if (opts.heap != NULL && !router.setHeap(opts.heap)) {
+        printf("Unknown heap %s, expected binary, radix, dial or 4ary\n", opts.heap);
+        return -1;
+    }
+    if (opts.tables != NULL && !router.selectTables(opts.tables)) {
+        printf("Invalid table list %s\n", opts.tables);
+        return -1;
+    }
 
-    // Open the changes file
+    // Read the changes file
     // File format: <ID of a node> <ID of another node> <cost of the link between them>
-    FILE *fp = fopen(argv[3], "r");
-    if (fp == NULL) {
-        printf("Error opening file %s\n", argv[3]);
+    vector<vector<Change>> epochs;
+    if (!readChangeEpochs(argv[arg + 2], opts, epochs)) {
+        printf("Error opening file %s\n", argv[arg + 2]);
         return -1;
     }
-    FILE *fpOut;
-    fpOut = fopen("output.txt", "w");
-    if (fpOut == NULL) {
+    int fdOut = open("output.txt", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fdOut == -1) {
         printf("Error opening file output.txt\n");
-        fclose(fp);
         return -1;
     }
+    OutputBuffer out(fdOut);
+    OutputBuffer stdoutBuffer(STDOUT_FILENO);
+    OutputBuffer *console = opts.quiet ? NULL : &stdoutBuffer;
 
-    int u = -1;
-    int v = -1;
-    int w = -1;
-    do {
-        if (u != -1 && v != -1 && w != -1) {
-            // Update the edge in the graph
-            router.updateEdge(u, v, w);
-        }
-        // Run Dijkstra's algorithm for each node
-        for (int i = 1; i <= router.getNumNodes(); i++) {
-            if (!router.hasInput(i)) {
-                // Skip nodes that are not in the topology
-                continue;
+    // Apply the changes coming before an epoch and bring the tables up to date
+    auto update = [&](const vector<Change> &changes, int epoch) {
+        if (router.isLazy()) {
+            // Update the edges in the graph, dropping the cached rows they affect
+            for (auto &change : changes) {
+                router.updateEdge(change.u, change.v, change.w);
+            }
+            // Run Dijkstra's algorithm only for the selected tables and the message sources
+            PROFILE_PHASE(PHASE_PATHS);
+            router.calculateNeededRows(pool);
+        } else if (epoch > 0 && opts.incremental) {
+            // Repair only the parts of the shortest path trees affected by each change
+            {
+                PROFILE_PHASE(PHASE_PATHS);
+                for (auto &change : changes) {
+                    router.updatePaths(change.u, change.v, change.w, pool);
+                    if (opts.stats) {
+                        fprintf(stderr, "[*] Change %d %d %d: repaired %d sources, %lld nodes\n", change.u,
+                                change.v, change.w, router.getTouchedSources(), router.getTouchedNodes());
+                    }
+                }
+            }
+            PROFILE_PHASE(PHASE_TABLES);
+            pool.parallelFor(router.getNumNodes(), [&](int i) { router.buildForwardingTable(i); });
+        } else if (epoch > 0 || !router.isRestored()) {
+            // Update the edges in the graph
+            for (auto &change : changes) {
+                router.updateEdge(change.u, change.v, change.w);
             }
-            router.calculatePaths(i);
+            // Run Dijkstra's algorithm for each node, once per epoch
+            {
+                PROFILE_PHASE(PHASE_PATHS);
+                router.calculateAllPaths(pool);
+            }
+            if (!router.isCompact()) {
+                // Compact mode builds each table along with its paths, before packing them
+                PROFILE_PHASE(PHASE_TABLES);
+                pool.parallelFor(router.getNumNodes(), [&](int i) { router.buildForwardingTable(i); });
+            }
+        }
+        if (opts.ecmp) {
+            // Gather the equal-cost next hops out of the complete tables
+            PROFILE_PHASE(PHASE_TABLES);
+            router.calculateEcmp(pool);
+        }
+    };
+
+    // Epoch 0 is the initial topology, epoch k comes after the k-th change (or batch of changes)
+    vector<Change> no_changes;
+    for (int epoch = 0; epoch <= epochs.size(); epoch++) {
+        update((epoch > 0) ? epochs[epoch - 1] : no_changes, epoch);
+        if (epoch == 0 && opts.save_snapshot != NULL && !router.saveSnapshot(opts.save_snapshot, argv[arg])) {
+            fprintf(stderr, "[*] Could not save snapshot %s\n", opts.save_snapshot);
         }
-        for (int i = 1; i <= router.getNumNodes(); i++) {
-            if (!router.hasInput(i)) {
-                // Skip nodes that are not in the topology
-                continue;
+        if (opts.delta) {
+            out.putString("epoch ");
+            out.putInt(epoch);
+            out.putChar('\n');
+        }
+        // Print in node order, so the output does not depend on the number of threads
+        {
+            PROFILE_PHASE(PHASE_OUTPUT);
+            for (int i = 0; i < router.getNumNodes(); i++) {
+                if (!router.isTableSelected(i)) continue;
+                if (opts.delta) {
+                    router.writeForwardingTable(i, NULL, console);
+                    router.writeForwardingTableDelta(i, &out);
+                } else {
+                    router.writeForwardingTable(i, &out, console);
+                }
             }
-            router.buildForwardingTable(i);
-            router.printForwardingTable(i);
-            router.writeForwardingTable(i, fpOut);
+            router.writeMessages(&out, console);
+        }
+        if (opts.stats && opts.ecmp) {
+            long long multipath, next_hops;
+            router.countEcmpRoutes(multipath, next_hops);
+            fprintf(stderr, "[*] Epoch %d: %lld routes with several next hops, %lld next hops in all\n", epoch,
+                    multipath, next_hops);
         }
-        for (int i = 0; i < router.getNumMessages(); i++) {
-            router.printMessage(i);
-            router.writeMessage(i, fpOut);
+        if (opts.stats && router.isLazy()) {
+            fprintf(stderr, "[*] Epoch %d: computed %d of %d rows\n", epoch, router.getRowsComputed(),
+                    router.getNumNodes());
         }
-    } while (fscanf(fp, "%d %d %d", &u, &v, &w) != EOF);
+        PROFILE_EPOCH();
+    }
+
+    {
+        PROFILE_PHASE(PHASE_OUTPUT);
+        out.flush();
+    }
+    close(fdOut);
+    if (opts.stats) {
+        fprintf(stderr, "[*] Tables %.1f MB, peak RSS %.1f MB\n", router.getTableMB(), peakRssMB());
+    }
 
-    fclose(fp);
-    fclose(fpOut);
+    if (opts.serve != NULL) {
+        // Keep the tables resident and answer queries, each link change being an epoch of its own
+        RouteServer server(router, [&](const Change &change) { update({change}, 1); });
+        if (!server.run(opts.serve)) {
+            printf("Cannot serve on %s\n", opts.serve);
+            return -1;
+        }
+    }
 
+    if (opts.profile != NULL && !PROFILE_REPORT(opts.profile, "linkstate", opts.threads, router.getNumNodes(),
+                                                router.getNumLinks(), opts.profile_epochs)) {
+        fprintf(stderr, "[*] Could not write profile %s\n", opts.profile);
+    }
     return 0;
 }
@@ -0,0 +1,408 @@
+#ifndef LINKSTATE_HPP
+#define LINKSTATE_HPP
+
+#include "heap.hpp"
+#include "route.hpp"
+
+class LinkState : public BaseRouter {
+   public:
+    LinkState(const char *topofile, const char *messagefile, const char *snapshot = NULL, bool compact = false)
+        : BaseRouter(topofile, messagefile, snapshot, "linkstate", compact) {}
+    void calculateRow(int src) override {
+        calculatePaths(src);
+        buildForwardingTable(src);
+    }
+    void calculatePaths(int src) override {
+        if (delta_pool != NULL && g.minWeight() >= 0) {
+            deltaStepping(src, *delta_pool);
+            return;
+        }
+        // Radix and bucket queues need keys that never decrease, which only holds without negative links
+        Heap h = (g.minWeight() < 0) ? HEAP_BINARY : heap;
+        switch (h) {
+            case HEAP_RADIX:
+                dijkstra(src, localQueue<RadixHeap>());
+                break;
+            case HEAP_DIAL:
+                dijkstra(src, localQueue<BucketQueue>());
+                break;
+            case HEAP_QUATERNARY:
+                dijkstra(src, localQueue<QuaternaryHeap>());
+                break;
+            default:
+                dijkstra(src, localQueue<BinaryHeap>());
+                break;
+        }
+    }
+
+    /*
+     * Select the priority queue used by calculatePaths:
+     * binary (std::priority_queue), radix (the default), dial or 4ary, see heap.hpp.
+     * Return false if the name is unknown.
+     */
+    bool setHeap(const char *name) {
+        if (strcmp(name, "binary") == 0) {
+            heap = HEAP_BINARY;
+        } else if (strcmp(name, "radix") == 0) {
+            heap = HEAP_RADIX;
+        } else if (strcmp(name, "dial") == 0) {
+            heap = HEAP_DIAL;
+        } else if (strcmp(name, "4ary") == 0) {
+            heap = HEAP_QUATERNARY;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    /*
+     * Compute every source one after the other, each of them on the whole pool,
+     * when delta-stepping is selected. Otherwise one source runs per thread.
+     */
+    void calculateAllPaths(ThreadPool &pool) override {
+        if (delta_pool == NULL) {
+            BaseRouter::calculateAllPaths(pool);
+            return;
+        }
+        for (int src = 0; src < num_nodes; src++) {
+            calculatePaths(src);
+        }
+    }
+
+    /*
+     * Run calculatePaths with parallel delta-stepping on pool instead of Dijkstra,
+     * or go back to Dijkstra if pool is NULL. calculatePaths must then not be called
+     * from inside the pool, since the pool does not nest.
+     */
+    void useDeltaStepping(ThreadPool *pool) { delta_pool = pool; }
+
+    /*
+     * Apply a link change and repair the shortest path tree of every source
+     * instead of running Dijkstra again from scratch (dynamic SPF).
+     * Only the nodes whose distance can change are recomputed, and their prev
+     * is re-derived with the same lowest-ID tie-break as calculatePaths.
+     */
+    void updatePaths(int u, int v, int w, ThreadPool &pool) {
+        int old_w = getEdgeWeight(u, v);
+        updateEdge(u, v, w);
+        int new_w = getEdgeWeight(u, v);
+
+        touched_sources = 0;
+        touched_nodes = 0;
+        if (old_w == new_w) {
+            return;
+        }
+        vector<int> counts(num_nodes, 0);
+        pool.parallelFor(num_nodes, [&](int src) {
+            if (g.minWeight() < 0) {
+                // Repairs rely on costs that only grow along a path, so recompute the whole tree
+                calculatePaths(src);
+                counts[src] = num_nodes;
+                return;
+            }
+            counts[src] = repairPaths(src, getIndex(u), getIndex(v), old_w, new_w);
+        });
+        for (int count : counts) {
+            if (count > 0) {
+                touched_sources++;
+                touched_nodes += count;
+            }
+        }
+    }
+
+    int getTouchedSources() { return touched_sources; }
+    long long getTouchedNodes() { return touched_nodes; }
+
+   private:
+    enum Heap { HEAP_BINARY, HEAP_RADIX, HEAP_DIAL, HEAP_QUATERNARY };
+    Heap heap = HEAP_RADIX;
+    ThreadPool *delta_pool = NULL;  // Pool used by delta-stepping, NULL to run Dijkstra
+
+    int touched_sources = 0;    // Number of sources repaired by the last updatePaths
+    long long touched_nodes = 0;  // Number of nodes repaired by the last updatePaths
+
+    // Queue of the calling thread, kept between sources so its memory is reused
+    template <class Queue>
+    static Queue &localQueue() {
+        static thread_local Queue queue;
+        return queue;
+    }
+
+    /*
+     * Dijkstra's algorithm from src over any queue of heap.hpp.
+     * A node is only pushed when its distance improves. On a tie, prev moves to the
+     * lower neighbor ID without touching the queue, so prev ends up as the lowest-ID
+     * neighbor on a shortest path whatever order the queue settles equal keys in.
+     * Each node is settled once, so a negative link cannot keep the search going.
+     */
+    template <class Queue>
+    void dijkstra(int src, Queue &queue) {
+        static thread_local vector<char> settled;
+        int *d = distRow(src);
+        int *p = prevRow(src);
+
+        // Initialize distances
+        fill(d, d + num_nodes, INT_MAX);
+        fill(p, p + num_nodes, -1);
+        settled.assign(num_nodes, 0);
+
+        d[src] = 0;
+        p[src] = src;
+        queue.reset(num_nodes, g.maxWeight());
+        queue.push(src, 0);
+        PROFILE_COUNT(COUNT_SOURCES, 1);
+        PROFILE_COUNT(COUNT_HEAP_PUSHES, 1);
+        while (!queue.empty()) {
+            int du;
+            int u = queue.pop(du);
+            PROFILE_COUNT(COUNT_HEAP_POPS, 1);
+            if (du > d[u] || settled[u]) continue;  // Stale entry, or u lowered by a negative link once settled
+            settled[u] = 1;
+            PROFILE_COUNT(COUNT_RELAXATIONS, g.end(u) - g.begin(u));
+
+            for (int e = g.begin(u); e < g.end(u); e++) {
+                int v = g.neighbor(e);
+                int new_dist = du + g.weight(e);
+
+                if (new_dist < d[v]) {
+                    d[v] = new_dist;
+                    p[v] = u;
+                    queue.push(v, new_dist);
+                    PROFILE_COUNT(COUNT_HEAP_PUSHES, 1);
+                }
+                // If there is a tie, choose the lowest node ID
+                else if (new_dist == d[v] && (p[v] == -1 || u < p[v])) {
+                    p[v] = u;
+                }
+            }
+        }
+    }
+
+    // Lower *x to value if value is smaller, return whether it was lowered
+    static bool atomicMin(int *x, int value) {
+        int cur = __atomic_load_n(x, __ATOMIC_RELAXED);
+        while (value < cur) {
+            if (__atomic_compare_exchange_n(x, &cur, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*
+     * Relax the light (cost <= width) or heavy links out of nodes on the pool.
+     * The nodes are split into chunks, and every node whose distance was lowered
+     * is appended to the list of its chunk in improved.
+     */
+    void relaxLinks(int *d, const vector<int> &nodes, bool light, int width, ThreadPool &pool,
+                    vector<vector<int>> &improved) {
+        int chunks = (nodes.size() < 1024) ? 1 : min((int)nodes.size() / 256, pool.size() * 4);
+        improved.resize(max(chunks, (int)improved.size()));
+        for (auto &list : improved) list.clear();
+        auto relaxChunk = [&](int c) {
+            size_t first = nodes.size() * c / chunks;
+            size_t last = nodes.size() * (c + 1) / chunks;
+            for (size_t i = first; i < last; i++) {
+                int u = nodes[i];
+                int du = __atomic_load_n(&d[u], __ATOMIC_RELAXED);
+                PROFILE_COUNT(COUNT_RELAXATIONS, g.end(u) - g.begin(u));
+                for (int e = g.begin(u); e < g.end(u); e++) {
+                    if ((g.weight(e) <= width) != light) continue;
+                    if (atomicMin(&d[g.neighbor(e)], du + g.weight(e))) {
+                        improved[c].push_back(g.neighbor(e));
+                    }
+                }
+            }
+        };
+        if (chunks == 1) {
+            relaxChunk(0);
+        } else {
+            pool.parallelFor(chunks, relaxChunk);
+        }
+    }
+
+    /*
+     * Delta-stepping (Meyer and Sanders) from src, for links of non-negative cost.
+     * Nodes are kept in buckets of distance width. The smallest bucket is emptied by
+     * relaxing its light links in parallel until no node falls back into it, then the
+     * heavy links of every node it held are relaxed once. Once the distances are
+     * final, prev is derived from them with the lowest-ID tie-break, so dist and prev
+     * are exactly what dijkstra gives.
+     */
+    void deltaStepping(int src, ThreadPool &pool) {
+        int *d = distRow(src);
+        int *p = prevRow(src);
+        fill(d, d + num_nodes, INT_MAX);
+        d[src] = 0;
+        PROFILE_COUNT(COUNT_SOURCES, 1);
+
+        // Around the average link cost over the average degree, the usual choice for random graphs
+        long long degree_sum = max(2 * g.numEdges(), 1);
+        int width = max(1LL, (long long)g.maxWeight() * num_nodes / degree_sum);
+        // Tentative distances are at most one link cost ahead of the current bucket, so buckets can wrap
+        size_t num_buckets = g.maxWeight() / width + 2;
+        vector<vector<int>> buckets(num_buckets);
+        vector<vector<int>> improved;
+        vector<int> frontier, settled;
+        vector<int> frontier_mark(num_nodes, -1);  // Last round each node was taken into the frontier
+        vector<int> settled_mark(num_nodes, -1);   // Last bucket each node was settled in
+        long long queued = 1;
+        buckets[0].push_back(src);
+
+        // Move the nodes lowered by the last relaxLinks into their buckets
+        auto requeue = [&]() {
+            for (auto &list : improved) {
+                for (int v : list) {
+                    buckets[(d[v] / width) % num_buckets].push_back(v);
+                }
+                queued += list.size();
+            }
+        };
+
+        int bucket = 0;
+        int round = 0;
+        while (queued > 0) {
+            while (buckets[bucket % num_buckets].empty()) bucket++;
+            vector<int> &current = buckets[bucket % num_buckets];
+            settled.clear();
+            while (!current.empty()) {
+                frontier.clear();
+                queued -= current.size();
+                // Keep each node once, and only if its distance still falls in this bucket
+                for (int v : current) {
+                    if (d[v] / width != bucket || frontier_mark[v] == round) continue;
+                    frontier_mark[v] = round;
+                    frontier.push_back(v);
+                    if (settled_mark[v] != bucket) {
+                        settled_mark[v] = bucket;
+                        settled.push_back(v);
+                    }
+                }
+                current.clear();
+                round++;
+                relaxLinks(d, frontier, true, width, pool, improved);
+                requeue();
+            }
+            relaxLinks(d, settled, false, width, pool, improved);
+            requeue();
+        }
+
+        pool.parallelFor(num_nodes, [&](int v) {
+            if (d[v] == INT_MAX) {
+                p[v] = -1;
+                return;
+            }
+            int best = (v == src) ? src : -1;
+            for (int e = g.begin(v); e < g.end(v); e++) {
+                int u = g.neighbor(e);
+                if (d[u] == INT_MAX || d[u] + g.weight(e) != d[v]) continue;
+                if (best == -1 || u < best) best = u;
+            }
+            p[v] = best;
+        });
+    }
+
+    // Lowest-ID neighbor lying on a shortest path to v, which is what calculatePaths picks as prev
+    int tightPrev(int src, int v) {
+        int *d = distRow(src);
+        if (v == src) return src;
+        if (d[v] == INT_MAX) return -1;
+        int best = -1;
+        for (int e = g.begin(v); e < g.end(v); e++) {
+            int u = g.neighbor(e);
+            if (d[u] == INT_MAX || d[u] + g.weight(e) != d[v]) continue;
+            if (best == -1 || u < best) best = u;
+        }
+        return best;
+    }
+
+    /*
+     * Repair the dist and prev rows of src after the cost of the link between a and b
+     * changed from old_w to new_w (INT_MAX meaning no link).
+     * Return the number of nodes whose distance was recomputed.
+     */
+    int repairPaths(int src, int a, int b, int old_w, int new_w) {
+        int *d = distRow(src);
+        int *p = prevRow(src);
+        priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> pq;
+        vector<int> changed;
+
+        if (new_w > old_w) {
+            // The link got worse: only the subtree hanging below it can move away
+            int root = -1;
+            if (p[b] == a && b != src) root = b;
+            if (p[a] == b && a != src) root = a;
+            if (root == -1) return 0;
+
+            // Collect the subtree, marking its nodes with prev -2 until it is re-derived below
+            changed.push_back(root);
+            p[root] = -2;
+            for (int i = 0; i < changed.size(); i++) {
+                for (int e = g.begin(changed[i]); e < g.end(changed[i]); e++) {
+                    int x = g.neighbor(e);
+                    if (p[x] == changed[i] && x != src) {
+                        p[x] = -2;
+                        changed.push_back(x);
+                    }
+                }
+            }
+            for (int x : changed) {
+                d[x] = INT_MAX;
+            }
+            // Seed the subtree from its boundary with the rest of the tree
+            for (int x : changed) {
+                for (int e = g.begin(x); e < g.end(x); e++) {
+                    int y = g.neighbor(e);
+                    if (p[y] == -2 || d[y] == INT_MAX) continue;
+                    if (d[y] + g.weight(e) < d[x]) d[x] = d[y] + g.weight(e);
+                }
+                if (d[x] != INT_MAX) pq.push({d[x], x});
+            }
+        } else {
+            // The link got better: relax it and let the improvement spread
+            if (d[a] != INT_MAX && d[a] + new_w < d[b]) {
+                d[b] = d[a] + new_w;
+                pq.push({d[b], b});
+            }
+            if (d[b] != INT_MAX && d[b] + new_w < d[a]) {
+                d[a] = d[b] + new_w;
+                pq.push({d[a], a});
+            }
+        }
+
+        // Dijkstra restricted to the nodes that can still improve
+        PROFILE_COUNT(COUNT_SOURCES, 1);
+        PROFILE_COUNT(COUNT_HEAP_PUSHES, pq.size());
+        while (!pq.empty()) {
+            int du = pq.top().first;
+            int x = pq.top().second;
+            pq.pop();
+            PROFILE_COUNT(COUNT_HEAP_POPS, 1);
+            if (du > d[x]) continue;
+            if (new_w < old_w) changed.push_back(x);
+            PROFILE_COUNT(COUNT_RELAXATIONS, g.end(x) - g.begin(x));
+
+            for (int e = g.begin(x); e < g.end(x); e++) {
+                int y = g.neighbor(e);
+                if (du + g.weight(e) < d[y]) {
+                    d[y] = du + g.weight(e);
+                    pq.push({d[y], y});
+                    PROFILE_COUNT(COUNT_HEAP_PUSHES, 1);
+                }
+            }
+        }
+
+        // Re-derive prev for the changed nodes, their neighbors (which may now tie) and the link ends
+        p[a] = tightPrev(src, a);
+        p[b] = tightPrev(src, b);
+        for (int x : changed) {
+            p[x] = tightPrev(src, x);
+            for (int e = g.begin(x); e < g.end(x); e++) {
+                p[g.neighbor(e)] = tightPrev(src, g.neighbor(e));
+            }
+        }
+        return changed.size();
+    }
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include "output.hpp"
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "instrument.hpp"
+
+OutputBuffer::OutputBuffer(int fd, size_t capacity) : fd(fd), buffer(capacity), used(0) {}
+
+OutputBuffer::~OutputBuffer() {
+    flush();
+}
+
+// Hand everything buffered so far to the kernel
+void OutputBuffer::flush() {
+    PROFILE_PHASE(PHASE_WRITE);
+    size_t done = 0;
+    while (done < used) {
+        ssize_t n = write(fd, buffer.data() + done, used - done);
+        PROFILE_COUNT(COUNT_WRITE_CALLS, 1);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            perror("write");
+            break;
+        }
+        done += n;
+    }
+    PROFILE_COUNT(COUNT_BYTES_WRITTEN, done);
+    used = 0;
+}
+
+// Make sure the next len bytes fit without a flush, growing the buffer for very long lines
+void OutputBuffer::reserve(size_t len) {
+    if (used + len > buffer.size()) flush();
+    if (len > buffer.size()) buffer.resize(len);
+}
+
+void OutputBuffer::putString(const char* s, size_t len) {
+    while (len > 0) {
+        if (used == buffer.size()) flush();
+        size_t n = min(len, buffer.size() - used);
+        memcpy(buffer.data() + used, s, n);
+        used += n;
+        s += n;
+        len -= n;
+    }
+}
+
+// Format x in decimal without going through printf
+void OutputBuffer::putInt(int x) {
+    char digits[12];
+    int len = 0;
+    unsigned int value = (x < 0) ? 0u - (unsigned int)x : (unsigned int)x;
+    do {
+        digits[len++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    if (used + len + 1 > buffer.size()) flush();
+    if (x < 0) buffer[used++] = '-';
+    while (len > 0) {
+        buffer[used++] = digits[--len];
+    }
+}
+
+// Append what the other buffer received since mark
+void OutputBuffer::copyFrom(OutputBuffer& other, size_t mark) {
+    putString(other.buffer.data() + mark, other.used - mark);
+}
@@ -0,0 +1,41 @@
+#ifndef OUTPUT_HPP
+#define OUTPUT_HPP
+
+#include <string.h>
+
+#include <vector>
+
+using namespace std;
+
+/*
+ * Output written through one large reusable buffer.
+ * Text and integers are formatted by hand straight into the buffer, and the
+ * buffer goes to the file descriptor with a single write() whenever it fills up.
+ */
+class OutputBuffer {
+   public:
+    OutputBuffer(int fd, size_t capacity = 1 << 22);
+    ~OutputBuffer();
+
+    void flush();
+    void reserve(size_t len);
+
+    void putChar(char c) {
+        if (used == buffer.size()) flush();
+        buffer[used++] = c;
+    }
+    void putString(const char* s, size_t len);
+    void putString(const char* s) { putString(s, strlen(s)); }
+    void putInt(int x);
+
+    // Position to copy a finished line from, valid as long as enough room was reserved for the line
+    size_t mark() { return used; }
+    void copyFrom(OutputBuffer& other, size_t mark);
+
+   private:
+    int fd;
+    vector<char> buffer;
+    size_t used;
+};
+
+#endif
@@ -0,0 +1,195 @@
+#include "parser.hpp"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile() {
+    if (length > 0) {
+        munmap(data, length);
+    }
+}
+
+// Map the whole file, an empty file maps to an empty range
+bool MappedFile::open(const char* filename) {
+    int fd = ::open(filename, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return false;
+    }
+    length = st.st_size;
+    if (length > 0) {
+        void* mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            length = 0;
+            close(fd);
+            return false;
+        }
+        madvise(mapping, length, MADV_SEQUENTIAL);
+        data = (char*)mapping;
+    }
+    close(fd);
+    return true;
+}
+
+// Move to the next line, return false at the end of the file
+bool LineScanner::nextLine() {
+    if (next >= end) {
+        return false;
+    }
+    pos = next;
+    const char* newline = (const char*)memchr(pos, '\n', end - pos);
+    line_end = (newline != NULL) ? newline : end;
+    next = (newline != NULL) ? newline + 1 : end;
+    if (line_end > pos && line_end[-1] == '\r') {
+        line_end--;
+    }
+    line_no++;
+    return true;
+}
+
+// Read an optionally negative decimal integer, return false if there is none or it overflows
+bool LineScanner::readInt(int& x) {
+    skipSpaces();
+    bool negative = (pos < line_end && *pos == '-');
+    const char* p = pos + negative;
+    long long value = 0;
+    const char* first = p;
+    while (p < line_end && (unsigned)(*p - '0') <= 9 && p - first < 11) {
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+    if (p == first || (p < line_end && *p != ' ' && *p != '\t')) {
+        return false;
+    }
+    if (negative) value = -value;
+    if (value < INT_MIN || value > INT_MAX) {
+        return false;
+    }
+    x = (int)value;
+    pos = p;
+    return true;
+}
+
+// Whether only blanks are left on the current line
+bool LineScanner::atLineEnd() {
+    skipSpaces();
+    return pos == line_end;
+}
+
+// The rest of the current line after the leading blanks
+string LineScanner::readRest() {
+    skipSpaces();
+    string rest(pos, line_end - pos);
+    pos = line_end;
+    return rest;
+}
+
+void LineScanner::error(const char* expected) {
+    fprintf(stderr, "%s:%d: malformed line, expected %s\n", filename, line_no, expected);
+}
+
+// Input format: <ID of a node> <ID of another node> <cost of the link between them>
+bool parseTopologyFile(const char* filename, vector<Link>& links) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        return false;
+    }
+    LineScanner scanner(file, filename);
+    while (scanner.nextLine()) {
+        Link link;
+        if (scanner.atLineEnd()) {
+            continue;
+        }
+        if (!scanner.readInt(link.u) || !scanner.readInt(link.v) || !scanner.readInt(link.w) ||
+            !scanner.atLineEnd() || link.u < 0 || link.v < 0 || link.u > MAX_NODE_ID || link.v > MAX_NODE_ID) {
+            scanner.error("<node> <node> <cost>");
+            continue;
+        }
+        links.push_back(link);
+    }
+    return true;
+}
+
+// Input format: <source node ID> <dest node ID> <message text>
+bool parseMessageFile(const char* filename, vector<Message>& messages) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        return false;
+    }
+    LineScanner scanner(file, filename);
+    while (scanner.nextLine()) {
+        Message msg;
+        if (scanner.atLineEnd()) {
+            continue;
+        }
+        if (!scanner.readInt(msg.src) || !scanner.readInt(msg.dest)) {
+            scanner.error("<source> <dest> <message text>");
+            continue;
+        }
+        msg.message = scanner.readRest();
+        messages.push_back(msg);
+    }
+    return true;
+}
+
+// Input format: <ID of a node> <ID of another node> <new cost of the link, -999 to remove it>
+bool parseChangesFile(const char* filename, vector<Change>& changes) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        return false;
+    }
+    LineScanner scanner(file, filename);
+    while (scanner.nextLine()) {
+        Change change;
+        if (scanner.atLineEnd()) {
+            continue;
+        }
+        if (!scanner.readInt(change.u) || !scanner.readInt(change.v) || !scanner.readInt(change.w) ||
+            !scanner.atLineEnd()) {
+            scanner.error("<node> <node> <cost>");
+            continue;
+        }
+        changes.push_back(change);
+    }
+    return true;
+}
+
+/*
+ * Input format: change lines as in parseChangesFile, in batches separated by
+ * blank lines or "@<timestamp>" lines. Runs of separators do not make empty batches.
+ */
+bool parseChangeBatches(const char* filename, vector<vector<Change>>& batches) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        return false;
+    }
+    LineScanner scanner(file, filename);
+    bool in_batch = false;
+    while (scanner.nextLine()) {
+        Change change;
+        if (scanner.atLineEnd() || scanner.peek('@')) {
+            in_batch = false;
+            continue;
+        }
+        if (!scanner.readInt(change.u) || !scanner.readInt(change.v) || !scanner.readInt(change.w) ||
+            !scanner.atLineEnd()) {
+            scanner.error("<node> <node> <cost>");
+            continue;
+        }
+        if (!in_batch) {
+            batches.emplace_back();
+            in_batch = true;
+        }
+        batches.back().push_back(change);
+    }
+    return true;
+}
@@ -0,0 +1,88 @@
+#ifndef PARSER_HPP
+#define PARSER_HPP
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "graph.hpp"
+
+using namespace std;
+
+// Largest node ID a topology may use, node_index is sized by the largest ID (400 MB at this bound)
+const int MAX_NODE_ID = 99999999;
+
+struct Message {
+    int src;         // Source node ID
+    int dest;        // Destination node ID
+    string message;  // Message text
+};
+
+struct Change {
+    int u;  // ID of a node
+    int v;  // ID of another node
+    int w;  // New cost of the link between them, -999 to remove it
+};
+
+// Whole input file mapped read-only into memory
+class MappedFile {
+   public:
+    MappedFile() : data(NULL), length(0) {}
+    ~MappedFile();
+
+    bool open(const char* filename);
+    const char* begin() { return data; }
+    const char* end() { return data + length; }
+    size_t size() { return length; }
+
+   private:
+    char* data;
+    size_t length;
+};
+
+/*
+ * Scanner over the lines of a mapped file.
+ * Integers are read with a plain digit loop instead of scanf, and errors are
+ * reported with the file name and line number.
+ */
+class LineScanner {
+   public:
+    LineScanner(MappedFile& file, const char* filename)
+        : pos(file.begin()), end(file.end()), line_end(file.begin()), next(file.begin()), line_no(0),
+          filename(filename) {}
+
+    bool nextLine();
+    bool readInt(int& x);
+    bool atLineEnd();
+    string readRest();
+    // Whether the next non-blank character on the line is c
+    bool peek(char c) {
+        skipSpaces();
+        return pos < line_end && *pos == c;
+    }
+    void error(const char* expected);
+
+   private:
+    const char* pos;       // Current position in the current line
+    const char* end;       // End of the file
+    const char* line_end;  // End of the current line, without the newline
+    const char* next;      // Start of the next line
+    int line_no;           // Line number of the current line, starting from 1
+    const char* filename;
+
+    void skipSpaces() {
+        while (pos < line_end && (*pos == ' ' || *pos == '\t')) pos++;
+    }
+};
+
+/*
+ * Parse the input files. Malformed lines are reported on stderr and skipped.
+ * Return false if the file cannot be opened.
+ */
+bool parseTopologyFile(const char* filename, vector<Link>& links);
+bool parseMessageFile(const char* filename, vector<Message>& messages);
+bool parseChangesFile(const char* filename, vector<Change>& changes);
+bool parseChangeBatches(const char* filename, vector<vector<Change>>& batches);
+
+#endif
@@ -1,37 +1,230 @@
 #include "route.hpp"
 
-// Add an edge between u and v with weight w
-void BaseRouter::addEdge(int u, int v, int w) {
-    g[u].push_back({v, w});
-    g[v].push_back({u, w});
+#include <sys/resource.h>
+
+/*
+ * Parse the flags in front of the input files.
+ * Return the index of the first input file in argv, or -1 if a flag is malformed.
+ */
+int parseOptions(int argc, char **argv, RouterOptions &opts) {
+    int arg = 1;
+    while (arg < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-i") == 0 || strcmp(argv[arg], "--incremental") == 0) {
+            opts.incremental = true;
+        } else if (strcmp(argv[arg], "-j") == 0 && arg + 1 < argc) {
+            opts.threads = atoi(argv[++arg]);
+            if (opts.threads < 1) {
+                return -1;
+            }
+        } else if (strcmp(argv[arg], "--engine") == 0 && arg + 1 < argc) {
+            opts.engine = argv[++arg];
+        } else if (strcmp(argv[arg], "--stats") == 0) {
+            opts.stats = true;
+        } else if (strcmp(argv[arg], "--verify") == 0) {
+            opts.verify = true;
+        } else if (strcmp(argv[arg], "--no-poison") == 0) {
+            opts.poison = false;
+        } else if (strcmp(argv[arg], "--delta") == 0) {
+            opts.delta = true;
+        } else if (strcmp(argv[arg], "--quiet") == 0) {
+            opts.quiet = true;
+        } else if (strcmp(argv[arg], "--save-snapshot") == 0 && arg + 1 < argc) {
+            opts.save_snapshot = argv[++arg];
+        } else if (strcmp(argv[arg], "--load-snapshot") == 0 && arg + 1 < argc) {
+            opts.load_snapshot = argv[++arg];
+        } else if (strcmp(argv[arg], "--heap") == 0 && arg + 1 < argc) {
+            opts.heap = argv[++arg];
+        } else if (strcmp(argv[arg], "--serve") == 0 && arg + 1 < argc) {
+            opts.serve = argv[++arg];
+        } else if (strcmp(argv[arg], "--batch") == 0) {
+            opts.batch = true;
+        } else if (strcmp(argv[arg], "--tables") == 0 && arg + 1 < argc) {
+            opts.tables = argv[++arg];
+        } else if (strcmp(argv[arg], "--ecmp") == 0) {
+            opts.ecmp = true;
+        } else if (strcmp(argv[arg], "--areas") == 0 && arg + 1 < argc) {
+            opts.areas = argv[++arg];
+        } else if (strcmp(argv[arg], "--compact") == 0) {
+            opts.compact = true;
+        } else if (strcmp(argv[arg], "--profile") == 0 && arg + 1 < argc) {
+            opts.profile = argv[++arg];
+        } else if (strcmp(argv[arg], "--profile-epochs") == 0) {
+            opts.profile_epochs = true;
+        } else {
+            return -1;
+        }
+        arg++;
+    }
+    return arg;
 }
 
-// Remove the edge between u and v
-void BaseRouter::removeEdge(int u, int v) {
-    for (auto it = g[u].begin(); it != g[u].end(); ++it) {
-        if (it->first == v) {
-            g[u].erase(it);
-            break;
+/*
+ * Remap the node IDs that appear in links to dense indices in ID order, rewriting
+ * the links in place. Return the number of nodes.
+ */
+int remapNodes(vector<Link> &links, vector<int> &node_id, vector<int> &node_index) {
+    int max_id = 0;
+    for (auto &link : links) {
+        max_id = max(max_id, max(link.u, link.v));
+    }
+    node_index.assign(max_id + 1, -1);
+    for (auto &link : links) {
+        node_index[link.u] = 0;
+        node_index[link.v] = 0;
+    }
+    node_id.clear();
+    for (int id = 0; id <= max_id; id++) {
+        if (node_index[id] != -1) {
+            node_index[id] = node_id.size();
+            node_id.push_back(id);
         }
     }
-    for (auto it = g[v].begin(); it != g[v].end(); ++it) {
-        if (it->first == u) {
-            g[v].erase(it);
-            break;
+    for (auto &link : links) {
+        link.u = node_index[link.u];
+        link.v = node_index[link.v];
+    }
+    return node_id.size();
+}
+
+// Peak resident set size of the process so far
+double peakRssMB() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return usage.ru_maxrss / 1024.0;  // Kilobytes on Linux
+}
+
+/*
+ * Keep only the last change to each link, at the position of the first change to it.
+ * Applying the result gives the same graph as applying every change in order,
+ * as long as there is at most one link between two nodes.
+ * Return the number of changes dropped.
+ */
+int coalesceChanges(vector<Change> &changes) {
+    unordered_map<long long, int> slot;  // Link -> index of its change in the result
+    vector<Change> result;
+    for (auto &change : changes) {
+        long long key = ((long long)min(change.u, change.v) << 32) | (unsigned)max(change.u, change.v);
+        auto it = slot.find(key);
+        if (it == slot.end()) {
+            slot[key] = result.size();
+            result.push_back(change);
+        } else {
+            result[it->second] = change;
+        }
+    }
+    int dropped = changes.size() - result.size();
+    changes.swap(result);
+    return dropped;
+}
+
+/*
+ * Read the changes file into the changes to apply before each epoch after the first.
+ * By default every change line is an epoch of its own. With --batch, the epochs are
+ * the blank-line or @timestamp separated batches, coalesced with coalesceChanges.
+ * Return false if the file cannot be opened.
+ */
+bool readChangeEpochs(const char *filename, const RouterOptions &opts, vector<vector<Change>> &epochs) {
+    PROFILE_PHASE(PHASE_PARSE);
+    epochs.clear();
+    if (!opts.batch) {
+        vector<Change> changes;
+        if (!parseChangesFile(filename, changes)) {
+            return false;
         }
+        for (auto &change : changes) {
+            epochs.push_back({change});
+        }
+        return true;
+    }
+    if (!parseChangeBatches(filename, epochs)) {
+        return false;
+    }
+    for (int i = 0; i < epochs.size(); i++) {
+        int read = epochs[i].size();
+        int dropped = coalesceChanges(epochs[i]);
+        if (opts.stats) {
+            fprintf(stderr, "[*] Epoch %d: %d changes, %d after coalescing\n", i + 1, read, read - dropped);
+        }
+    }
+    return true;
+}
+
+// Add an edge between node IDs u and v with weight w
+void BaseRouter::addEdge(int u, int v, int w) {
+    int iu = getIndex(u);
+    int iv = getIndex(v);
+    if (iu == -1 || iv == -1) {
+        return;
     }
+    g.addEdge(iu, iv, w);
+}
+
+// Remove the edge between node IDs u and v
+void BaseRouter::removeEdge(int u, int v) {
+    int iu = getIndex(u);
+    int iv = getIndex(v);
+    if (iu == -1 || iv == -1) {
+        return;
+    }
+    g.removeEdge(iu, iv);
 }
 
 /*
  * Update the edge between u and v with the new weight w.
  * If w is -999, remove the edge instead.
  * If w is not -999, add the edge with the new weight.
+ * In lazy mode, the cached rows affected by the change are dropped.
+ * The nodes are fixed by the topology file, so a change naming any other node
+ * is reported on stderr and ignored.
  */
 void BaseRouter::updateEdge(int u, int v, int w) {
+    if (getIndex(u) == -1 || getIndex(v) == -1) {
+        fprintf(stderr, "Ignoring change %d %d %d: node is not in the topology\n", u, v, w);
+        return;
+    }
+    int old_w = getEdgeWeight(u, v);
     removeEdge(u, v);
     if (w != -999) {
         addEdge(u, v, w);
     }
+    if (isLazy()) {
+        invalidateRows(getIndex(u), getIndex(v), old_w, getEdgeWeight(u, v));
+    }
+}
+
+/*
+ * Drop the cached rows that a change of the link between a and b from old_w to
+ * new_w (INT_MAX meaning no link) can affect: the rows where the link was on a
+ * shortest path, and the rows where it now ties or improves one. In every other
+ * row the set of shortest paths, and so the tie-breaks, stay the same.
+ */
+void BaseRouter::invalidateRows(int a, int b, int old_w, int new_w) {
+    if (a == -1 || b == -1 || old_w == new_w) {
+        return;
+    }
+    for (int src = 0; src < num_nodes; src++) {
+        if (!row_valid[src]) continue;
+        long long da = distRow(src)[a];
+        long long db = distRow(src)[b];
+        if (da == INT_MAX && db == INT_MAX) continue;
+        bool was_tight = old_w != INT_MAX && (da + old_w == db || db + old_w == da);
+        bool now_tight = new_w != INT_MAX && (da + new_w <= db || db + new_w <= da);
+        if (was_tight || now_tight) {
+            row_valid[src] = 0;
+        }
+    }
+}
+
+// Get the cost of the cheapest link between node IDs u and v, INT_MAX if they are not connected
+int BaseRouter::getEdgeWeight(int u, int v) {
+    int iu = getIndex(u);
+    int iv = getIndex(v);
+    if (iu == -1 || iv == -1) {
+        return INT_MAX;
+    }
+    return g.getWeight(iu, iv);
 }
 
 // Read the topology file and build the graph
@@ -44,26 +237,22 @@ void BaseRouter::readTopologyFile(const char *filename) {
      * 4 1 1
      * 4 5 1
      */
-    FILE *fp = fopen(filename, "r");
-    if (fp == NULL) {
+    vector<Link> links;
+    if (!parseTopologyFile(filename, links)) {
         printf("Error opening file %s\n", filename);
         return;
     }
+    num_nodes = remapNodes(links, node_id, node_index);
+    g.build(num_nodes, links);
 
-    int u, v, w;
-    while (fscanf(fp, "%d %d %d", &u, &v, &w) != EOF) {
-        has_input[u] = true;
-        has_input[v] = true;
-        addEdge(u, v, w);
-        // Update the number of nodes
-        if (u > num_nodes) {
-            num_nodes = u;
-        }
-        if (v > num_nodes) {
-            num_nodes = v;
-        }
+    if (compact) {
+        packed_dist.assign(num_nodes, PackedRow());
+        packed_port.assign(num_nodes, PackedRow());
+        return;
     }
-    fclose(fp);
+    dist.assign((size_t)num_nodes * num_nodes, INT_MAX);
+    prev.assign((size_t)num_nodes * num_nodes, -1);
+    next.assign((size_t)num_nodes * num_nodes, -1);
 }
 
 // Read the message file and store the messages in the vector
@@ -72,144 +261,401 @@ void BaseRouter::readMessageFile(const char *filename) {
      * Example:
      * 2 1 here is a message from 2 to 1
      */
-    FILE *fp = fopen(filename, "r");
-    if (fp == NULL) {
+    if (!parseMessageFile(filename, messages)) {
         printf("Error opening file %s\n", filename);
+    }
+}
+
+/*
+ * Compute the paths of every source on the pool, each source only writes its own rows.
+ * In compact mode the whole row is computed on the side and packed right away.
+ */
+void BaseRouter::calculateAllPaths(ThreadPool &pool) {
+    if (compact) {
+        pool.parallelFor(num_nodes, [this](int src) {
+            calculateRow(src);
+            packRow(src);
+        });
         return;
     }
+    pool.parallelFor(num_nodes, [this](int src) { calculatePaths(src); });
+}
 
-    int src, dest;
-    char message[100];
-    while (fscanf(fp, "%d %d %[^\n]", &src, &dest, message) != EOF) {
-        Message msg;
-        msg.src = src;
-        msg.dest = dest;
-        strncpy(msg.message, message, sizeof(msg.message));
-        messages.push_back(msg);
+/*
+ * Switch to lazy mode and only print the tables of the given nodes.
+ * list is a comma separated list of node IDs, or "none" to only route the messages.
+ * IDs that are not in the topology are reported and ignored.
+ * Return false if the list is malformed.
+ */
+bool BaseRouter::selectTables(const char *list) {
+    selected.assign(num_nodes, 0);
+    row_valid.assign(num_nodes, restored ? 1 : 0);
+    if (strcmp(list, "none") == 0) {
+        return true;
     }
-    fclose(fp);
+    const char *p = list;
+    while (*p != '\0') {
+        char *end;
+        long id = strtol(p, &end, 10);
+        if (end == p || (*end != ',' && *end != '\0')) {
+            return false;
+        }
+        int node = (id >= 0 && id <= INT_MAX) ? getIndex(id) : -1;
+        if (node == -1) {
+            fprintf(stderr, "Ignoring table of node %ld: node is not in the topology\n", id);
+        } else {
+            selected[node] = 1;
+        }
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return true;
 }
 
-// Build the forwarding table for a given source node by using prev vector
-// Used for Link State Routing, but not for Distance Vector Routing
+// Make sure the rows of src are up to date, computing them if they are not
+void BaseRouter::ensureRow(int src) {
+    if (!isLazy() || row_valid[src]) {
+        return;
+    }
+    calculateRow(src);
+    row_valid[src] = 1;
+    rows_computed++;
+}
+
+/*
+ * Compute the missing rows of the selected tables and of the message sources on the pool.
+ * Rows of the nodes in the middle of a message path are computed later by getPath.
+ * Resets the count returned by getRowsComputed.
+ */
+void BaseRouter::calculateNeededRows(ThreadPool &pool) {
+    vector<char> needed(selected);
+    for (auto &msg : messages) {
+        int src = getIndex(msg.src);
+        if (src != -1) needed[src] = 1;
+    }
+    vector<int> missing;
+    for (int src = 0; src < num_nodes; src++) {
+        if (needed[src] && !row_valid[src]) missing.push_back(src);
+    }
+    pool.parallelFor(missing.size(), [&](int i) { calculateRow(missing[i]); });
+    for (int src : missing) {
+        row_valid[src] = 1;
+    }
+    rows_computed = missing.size();
+}
+
+/*
+ * Build the forwarding table for a given source node by using prev vector
+ * Used for Link State Routing, but not for Distance Vector Routing
+ * Every node inherits the next hop of its prev, so each prev chain is only
+ * climbed up to the first node already resolved, and the whole row takes O(N).
+ */
 void BaseRouter::buildForwardingTable(int src) {
-    next[src].clear();
-    next[src].resize(num_nodes + 1, -1);
+    static thread_local vector<int> chain;
+    int *d = distRow(src);
+    int *p = prevRow(src);
+    int *nh = nextRow(src);
 
-    for (int i = 1; i <= num_nodes; i++) {
-        // No path found
-        if (dist[src][i] == INT_MAX) {
-            next[src][i] = -1;
+    // No path found leaves -1, and the source node is its own next hop
+    fill(nh, nh + num_nodes, -1);
+    nh[src] = src;
+    for (int i = 0; i < num_nodes; i++) {
+        if (d[i] == INT_MAX || nh[i] != -1) {
             continue;
         }
-        // The source node is the destination itself, so next hop is the source
-        if (i == src) {
-            next[src][i] = src;
-            continue;
+        // Climb until a resolved node, or a node directly connected to the source
+        chain.clear();
+        int cur = i;
+        while (nh[cur] == -1 && p[cur] != src) {
+            chain.push_back(cur);
+            nh[cur] = -2;  // On the chain, so a prev cycle over zero-cost links still stops
+            cur = p[cur];
         }
-        // The previous node is the source itself, so next hop is the destination.
-        // That is to say, they are directly connected.
-        if (prev[src][i] == src) {
-            next[src][i] = i;
-            continue;
+        if (nh[cur] == -1) {
+            // The previous node is the source itself, so next hop is the destination
+            nh[cur] = cur;
         }
-        // Recursively find the previous node until we reach the source node
-        int cur = prev[src][i];
-        while (prev[src][cur] != src) {
-            cur = prev[src][cur];
+        int hop = (nh[cur] >= 0) ? nh[cur] : cur;
+        for (int x : chain) {
+            nh[x] = hop;
         }
-        next[src][i] = cur;
     }
 }
 
-// Print the forwarding table for a given node
-void BaseRouter::printForwardingTable(int node) {
-    printf("Forwarding table for node %d:\n", node);
-    printf("Dest\tNext Hop\tCost\n");
-    for (int i = 1; i <= num_nodes; i++) {
-        if (dist[node][i] == INT_MAX || !has_input[i]) {
+/*
+ * Write the forwarding table for a given node in one pass:
+ * "<dest> <next hop> <cost>" lines to out, and the same table with a header to console.
+ * In ECMP mode the next hop column lists every equal-cost next hop, comma separated
+ * and in increasing ID order, so a route without alternatives reads as before.
+ * Either buffer may be NULL.
+ */
+void BaseRouter::writeForwardingTable(int node, OutputBuffer *out, OutputBuffer *console) {
+    static thread_local vector<int> hops;
+    if (compact) {
+        unpackRow(node);
+    }
+    int *d = distRow(node);
+    int *nh = nextRow(node);
+    if (console != NULL) {
+        console->putString("Forwarding table for node ");
+        console->putInt(node_id[node]);
+        console->putString(isEcmp() ? ":\nDest\tNext Hops\tCost\n" : ":\nDest\tNext Hop\tCost\n");
+    }
+    for (int i = 0; i < num_nodes; i++) {
+        if (d[i] == INT_MAX) {
             continue;
         }
-        printf("%d\t%d\t\t%d\n", i, next[node][i], dist[node][i]);
+        if (isEcmp() && i != node) {
+            getEcmpNextHops(node, i, hops);
+            if (hops.empty()) hops.push_back(nh[i]);
+            OutputBuffer *buffers[2] = {out, console};
+            for (OutputBuffer *buffer : buffers) {
+                if (buffer == NULL) continue;
+                buffer->putInt(node_id[i]);
+                buffer->putChar(buffer == out ? ' ' : '\t');
+                for (int k = 0; k < hops.size(); k++) {
+                    if (k > 0) buffer->putChar(',');
+                    buffer->putInt(node_id[hops[k]]);
+                }
+                buffer->putString(buffer == out ? " " : "\t\t");
+                buffer->putInt(d[i]);
+                buffer->putChar('\n');
+            }
+            continue;
+        }
+        if (out != NULL) {
+            out->putInt(node_id[i]);
+            out->putChar(' ');
+            out->putInt(node_id[nh[i]]);
+            out->putChar(' ');
+            out->putInt(d[i]);
+            out->putChar('\n');
+        }
+        if (console != NULL) {
+            console->putInt(node_id[i]);
+            console->putChar('\t');
+            console->putInt(node_id[nh[i]]);
+            console->putString("\t\t");
+            console->putInt(d[i]);
+            console->putChar('\n');
+        }
     }
 }
 
 /*
- *    Print the message at the given index with the format:
- *    from <x> to <y> cost <path_cost> hops <hop1> <hop2> <...> message <message>
- *    If the path is not found, print:
- *    from <x> to <y> cost infinite hops unreachable message <message>
+ * Write only the entries of the forwarding table that changed since the previous epoch:
+ * <node> <dest> <next hop> <cost> for a new or changed route
+ * <node> <dest> - for a route that became unreachable
+ * The first epoch is compared against empty tables, so it writes every entry.
  */
-void BaseRouter::printMessage(int index) {
-    if (index < 0 || index >= messages.size()) {
-        printf("Invalid message index\n");
-        return;
-    }
-    Message msg = messages[index];
-
-    int src = msg.src;
-    int dest = msg.dest;
-    int path_cost = dist[src][dest];
-    vector<int> path = getPath(src, dest);
-    if (path.empty()) {
-        printf("from %d to %d cost infinite hops unreachable message %s\n", src, dest, msg.message);
-        return;
+void BaseRouter::writeForwardingTableDelta(int node, OutputBuffer *out) {
+    if (last_dist.empty()) {
+        last_dist.assign((size_t)num_nodes * num_nodes, INT_MAX);
+        last_next.assign((size_t)num_nodes * num_nodes, -1);
     }
-    printf("from %d to %d cost %d hops ", src, dest, path_cost);
-    for (int i = 0; i < path.size(); i++) {
-        printf("%d ", path[i]);
+    int *d = distRow(node);
+    int *nh = nextRow(node);
+    int *ld = &last_dist[(size_t)node * num_nodes];
+    int *ln = &last_next[(size_t)node * num_nodes];
+    for (int i = 0; i < num_nodes; i++) {
+        if (d[i] == ld[i] && (d[i] == INT_MAX || nh[i] == ln[i])) {
+            continue;
+        }
+        out->putInt(node_id[node]);
+        out->putChar(' ');
+        out->putInt(node_id[i]);
+        if (d[i] == INT_MAX) {
+            out->putString(" -\n");
+        } else {
+            out->putChar(' ');
+            out->putInt(node_id[nh[i]]);
+            out->putChar(' ');
+            out->putInt(d[i]);
+            out->putChar('\n');
+        }
+        ld[i] = d[i];
+        ln[i] = nh[i];
     }
-    printf("message %s\n", msg.message);
 }
 
-// Get the path from src to dest
-vector<int> BaseRouter::getPath(int src, int dest) {
-    vector<int> path;
-    if (dist[src][dest] == INT_MAX) {
-        return path;  // No path found
+// Get the path from src to dest into path, which is cleared first
+void BaseRouter::getPath(int src, int dest, vector<int> &path) {
+    path.clear();
+    if (src == -1 || dest == -1) {
+        return;
+    }
+    ensureRow(src);
+    if (getCost(src, dest) == INT_MAX) {
+        return;  // No path found
     }
     int cur = src;
     while (cur != dest) {
         path.push_back(cur);
-        cur = next[cur][dest];
+        ensureRow(cur);
+        cur = getNextHop(cur, dest);
     }
     // Do not record the last node
-    return path;
 }
 
-// Write the forwarding table for a given node to a file
-void BaseRouter::writeForwardingTable(int node, FILE *fp) {
-    for (int i = 1; i <= num_nodes; i++) {
-        if (dist[node][i] == INT_MAX || !has_input[i]) {
-            continue;
+/*
+ * Look up the route between node IDs src_id and dest_id, computing the rows it needs in lazy mode.
+ * Return false if there is none, otherwise set its cost, its next hop ID and, unless
+ * hop_ids is NULL, the node IDs along it as written in output.txt.
+ */
+bool BaseRouter::lookupRoute(int src_id, int dest_id, int &cost, int &next_hop_id, vector<int> *hop_ids) {
+    int src = getIndex(src_id);
+    int dest = getIndex(dest_id);
+    if (src == -1 || dest == -1) {
+        return false;
+    }
+    ensureRow(src);
+    if (getCost(src, dest) == INT_MAX) {
+        return false;
+    }
+    cost = getCost(src, dest);
+    next_hop_id = node_id[getNextHop(src, dest)];
+    if (hop_ids != NULL) {
+        getPath(src, dest, *hop_ids);
+        if (hop_ids->empty()) {
+            return false;  // output.txt has messages to oneself as unreachable
+        }
+        for (int &hop : *hop_ids) {
+            hop = node_id[hop];
+        }
+    }
+    return true;
+}
+
+/*
+ * Write every message in order, like writeMessage.
+ * Paths to the same destination merge along the way, so the messages are walked
+ * grouped by destination, and a walk stops reading the next tables as soon as it
+ * reaches a node already on an earlier path to that destination.
+ */
+void BaseRouter::writeMessages(OutputBuffer *out, OutputBuffer *console) {
+    int num_messages = messages.size();
+    if (isEcmp()) {
+        // Every message is a flow of its own, hashed over the equal-cost paths
+        for (int i = 0; i < num_messages; i++) {
+            getEcmpPath(getIndex(messages[i].src), getIndex(messages[i].dest), flowHash(i), path_buffer);
+            writeMessageLine(i, path_buffer.data(), path_buffer.size(), out, console);
+        }
+        return;
+    }
+    vector<int> src(num_messages), dest(num_messages);
+    vector<int> start(num_messages, 0), length(num_messages, 0);  // Path of each message in path_buffer
+
+    // Counting sort of the routable messages by destination
+    vector<int> order, first(num_nodes + 1, 0);
+    for (int i = 0; i < num_messages; i++) {
+        src[i] = getIndex(messages[i].src);
+        dest[i] = getIndex(messages[i].dest);
+        if (src[i] != -1 && dest[i] != -1) first[dest[i] + 1]++;
+    }
+    for (int x = 0; x < num_nodes; x++) first[x + 1] += first[x];
+    order.resize(first[num_nodes]);
+    vector<int> fill_pos(first.begin(), first.end() - 1);
+    for (int i = 0; i < num_messages; i++) {
+        if (src[i] != -1 && dest[i] != -1) order[fill_pos[dest[i]]++] = i;
+    }
+
+    vector<int> suffix_start(num_nodes, -1);  // Where the path from each node starts in path_buffer, for this destination
+    vector<int> suffix_length(num_nodes, 0);
+    vector<int> seen;
+    path_buffer.clear();
+    for (int x = 0; x < num_nodes; x++) {
+        for (int k = first[x]; k < first[x + 1]; k++) {
+            int i = order[k];
+            ensureRow(src[i]);
+            if (getCost(src[i], x) == INT_MAX) continue;
+            start[i] = path_buffer.size();
+            int cur = src[i];
+            while (cur != x && suffix_start[cur] == -1) {
+                path_buffer.push_back(cur);
+                ensureRow(cur);
+                cur = getNextHop(cur, x);
+            }
+            int walked = path_buffer.size() - start[i];
+            if (cur != x) {
+                // Copy the rest from the earlier path through cur
+                int from = suffix_start[cur];
+                for (int h = 0; h < suffix_length[cur]; h++) path_buffer.push_back(path_buffer[from + h]);
+            }
+            length[i] = path_buffer.size() - start[i];
+            for (int h = 0; h < walked; h++) {
+                int node = path_buffer[start[i] + h];
+                suffix_start[node] = start[i] + h;
+                suffix_length[node] = length[i] - h;
+                seen.push_back(node);
+            }
         }
-        fprintf(fp, "%d %d %d\n", i, next[node][i], dist[node][i]);
+        for (int node : seen) suffix_start[node] = -1;
+        seen.clear();
+    }
+
+    for (int i = 0; i < num_messages; i++) {
+        writeMessageLine(i, path_buffer.data() + start[i], length[i], out, console);
     }
 }
 
-/*Write the message at the given index to a file with the format:
- *from <x> to <y> cost <path_cost> hops <hop1> <hop2> <...> message <message>
- *If the path is not found, write:
- *from <x> to <y> cost infinite hops unreachable message <message>
+/*
+ * Write the message at the given index with the format:
+ * from <x> to <y> cost <path_cost> hops <hop1> <hop2> <...> message <message>
+ * If the path is not found, write:
+ * from <x> to <y> cost infinite hops unreachable message <message>
+ * The line is formatted once into out (or console when out is NULL) and copied to the other one.
  */
-void BaseRouter::writeMessage(int index, FILE *fp) {
+void BaseRouter::writeMessage(int index, OutputBuffer *out, OutputBuffer *console) {
+    OutputBuffer *first = (out != NULL) ? out : console;
+    OutputBuffer *second = (out != NULL) ? console : NULL;
+    if (first == NULL) {
+        return;
+    }
     if (index < 0 || index >= messages.size()) {
-        fprintf(fp, "Invalid message index\n");
+        first->putString("Invalid message index\n");
+        if (second != NULL) second->putString("Invalid message index\n");
         return;
     }
-    Message msg = messages[index];
+    getPath(getIndex(messages[index].src), getIndex(messages[index].dest), path_buffer);
+    writeMessageLine(index, path_buffer.data(), path_buffer.size(), out, console);
+}
 
-    int src = msg.src;
-    int dest = msg.dest;
-    int path_cost = dist[src][dest];
-    vector<int> path = getPath(src, dest);
-    if (path.empty()) {
-        fprintf(fp, "from %d to %d cost infinite hops unreachable message %s\n", src, dest, msg.message);
+// Write the line of the message at the given index for a path of length hops, empty if unreachable
+void BaseRouter::writeMessageLine(int index, const int *hops, int length, OutputBuffer *out, OutputBuffer *console) {
+    OutputBuffer *first = (out != NULL) ? out : console;
+    OutputBuffer *second = (out != NULL) ? console : NULL;
+    if (first == NULL) {
         return;
     }
-    fprintf(fp, "from %d to %d cost %d hops ", src, dest, path_cost);
-    for (int i = 0; i < path.size(); i++) {
-        fprintf(fp, "%d ", path[i]);
+    Message &msg = messages[index];
+    size_t text_len = msg.message.size();
+    // The longest line this can be, so that nothing is flushed before the line is copied from mark
+    const size_t int_len = 11;  // "-2147483648"
+    size_t head_len = strlen("from ") + int_len + strlen(" to ") + int_len;
+    size_t unreachable_len = strlen(" cost infinite hops unreachable message ");
+    size_t reachable_len = strlen(" cost ") + int_len + strlen(" hops ") + (int_len + 1) * (size_t)length + strlen("message ");
+    first->reserve(head_len + max(unreachable_len, reachable_len) + text_len + 1);
+    size_t mark = first->mark();
+
+    first->putString("from ");
+    first->putInt(msg.src);
+    first->putString(" to ");
+    first->putInt(msg.dest);
+    if (length == 0) {
+        first->putString(" cost infinite hops unreachable message ");
+    } else {
+        first->putString(" cost ");
+        first->putInt(getCost(hops[0], getIndex(msg.dest)));
+        first->putString(" hops ");
+        for (int k = 0; k < length; k++) {
+            first->putInt(node_id[hops[k]]);
+            first->putChar(' ');
+        }
+        first->putString("message ");
+    }
+    first->putString(msg.message.data(), text_len);
+    first->putChar('\n');
+
+    if (second != NULL) {
+        second->copyFrom(*first, mark);
     }
-    fprintf(fp, "message %s\n", msg.message);
-}
\ No newline at end of file
+}
@@ -2,63 +2,196 @@
 #define ROUTE_HPP
 
 #include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
 #include <iostream>
 #include <queue>
 #include <unordered_map>
 #include <vector>
 
+#include "graph.hpp"
+#include "instrument.hpp"
+#include "output.hpp"
+#include "parser.hpp"
+#include "threadpool.hpp"
+
 using namespace std;
 
-struct Message {
-    int src;            // Source node ID
-    int dest;           // Destination node ID
-    char message[100];  // Message text
+// Command line flags shared by linkstate and distvec, given in front of the input files
+struct RouterOptions {
+    int threads = 1;           // -j N: worker threads used to compute all sources
+    bool incremental = false;  // -i: repair the shortest path trees on changes (linkstate only)
+    const char* engine = NULL;  // --engine NAME: path computation engine, NULL for the default one
+    bool stats = false;         // --stats: report per-change work counters on stderr
+    bool verify = false;        // --verify: check the simulated tables against distvec (dvsim only)
+    bool poison = true;         // --no-poison: advertise routes back to their next hop (dvsim only)
+    bool delta = false;         // --delta: only write the table entries that changed since the last epoch
+    bool quiet = false;         // --quiet: do not print the tables and messages on stdout
+    const char* save_snapshot = NULL;  // --save-snapshot FILE: save the routing state of the initial topology
+    const char* load_snapshot = NULL;  // --load-snapshot FILE: restore that state instead of recomputing it
+    const char* heap = NULL;    // --heap NAME: priority queue used by Dijkstra (linkstate only)
+    bool batch = false;         // --batch: apply the changes in blank-line or @timestamp separated epochs
+    const char* serve = NULL;   // --serve ADDRESS: answer route queries on a socket after the run, see server.hpp
+    const char* tables = NULL;  // --tables ID,ID,...|none: only compute and print these tables, see selectTables
+    bool ecmp = false;          // --ecmp: keep every equal-cost next hop and spread the messages over them
+    const char* areas = NULL;   // --areas auto[:SIZE]|FILE: route over areas with small tables (linkstate only), see area.hpp
+    bool compact = false;       // --compact: keep the tables packed in the narrowest widths, see compact.cpp
+    const char* profile = NULL;  // --profile FILE: write the JSON summary of a make INSTRUMENT=1 build, see instrument.hpp
+    bool profile_epochs = false;  // --profile-epochs: break the summary down per epoch
+};
+
+int parseOptions(int argc, char** argv, RouterOptions& opts);
+int remapNodes(vector<Link>& links, vector<int>& node_id, vector<int>& node_index);
+int coalesceChanges(vector<Change>& changes);
+double peakRssMB();
+bool readChangeEpochs(const char* filename, const RouterOptions& opts, vector<vector<Change>>& epochs);
+
+/*
+ * A row of ints stored in 1, 2 or 4 bytes per entry, the narrowest width that
+ * holds its values. In 1 and 2 bytes, values are non-negative and the all-ones
+ * pattern stands for the missing value given to pack.
+ */
+struct PackedRow {
+    vector<uint8_t> data;
+    int width = 4;
+    int missing = -1;
+
+    void pack(const int* values, int count, int missing_value);
+    int get(int i) const {
+        if (width == 1) {
+            return data[i] == UINT8_MAX ? missing : data[i];
+        }
+        if (width == 2) {
+            uint16_t x;
+            memcpy(&x, &data[(size_t)i * 2], 2);
+            return x == UINT16_MAX ? missing : x;
+        }
+        int x;
+        memcpy(&x, &data[(size_t)i * 4], 4);
+        return x;
+    }
 };
 
+/*
+ * Nodes are remapped to dense indices 0..num_nodes-1 in increasing ID order, so
+ * comparing indices gives the same lowest-ID tie-breaks as comparing IDs.
+ * Routing functions take dense indices, while addEdge/removeEdge/updateEdge take
+ * node IDs as they appear in the topology and changes files.
+ */
 class BaseRouter {
    protected:
-    unordered_map<int, vector<pair<int, int>>> g;  // Graph represented as an adjacency list
-    unordered_map<int, vector<int>> dist;          // Distance from the node to each other node
-    unordered_map<int, vector<int>> prev;          // Previous node in the shortest path
-    unordered_map<int, vector<int>> next;          // Next node in the shortest path
+    Graph g;                 // Graph represented as a CSR adjacency list over dense indices
+    vector<int> node_id;     // Node ID of each dense index
+    vector<int> node_index;  // Dense index of each node ID, -1 if the ID is not in the topology
+    vector<int> dist;        // Distance from the node to each other node, one row of num_nodes per source
+    vector<int> prev;        // Previous node in the shortest path, same layout as dist
+    vector<int> next;        // Next node in the shortest path, same layout as dist
+    vector<int> last_dist;   // dist as of the previous epoch, only kept for delta output
+    vector<int> last_next;   // next as of the previous epoch, only kept for delta output
     vector<Message> messages;
-    unordered_map<int, bool> has_input;  // Check if the node has input by the user
-    int num_nodes;                       // Number of nodes in the graph
+    vector<int> path_buffer;  // Scratch path reused by writeMessage
+    int num_nodes;            // Number of nodes in the graph
+    const char* kind;         // Name of the router written into snapshots, NULL if it cannot save them
+    bool restored;            // Whether the graph and tables were restored from a snapshot
+    vector<char> row_valid;   // Whether each row is up to date, empty unless rows are computed lazily
+    vector<char> selected;    // Whether the table of each node is printed, empty to print every table
+    int rows_computed;        // Rows computed since the last calculateNeededRows
+    vector<uint64_t> ecmp;    // Equal-cost next hop bitsets, empty unless ECMP is on, see ecmp.cpp
+    vector<size_t> ecmp_row;  // Start of the bitsets of each source in ecmp
+    vector<int> ecmp_words;   // Length of each bitset of each source, in 64-bit words
+    bool compact;                   // Whether the tables are packed, see compact.cpp
+    vector<PackedRow> packed_dist;  // Costs from each source, in compact mode
+    vector<PackedRow> packed_port;  // Next hops from each source as link slots of the source, in compact mode
+
+    // In compact mode these are the rows of the source being computed or unpacked on this thread
+    int* distRow(int src) { return compact ? scratchRow(0) : &dist[(size_t)src * num_nodes]; }
+    int* prevRow(int src) { return compact ? scratchRow(1) : &prev[(size_t)src * num_nodes]; }
+    int* nextRow(int src) { return compact ? scratchRow(2) : &next[(size_t)src * num_nodes]; }
+    int* scratchRow(int k);
+    void packRow(int src);
+    void unpackRow(int src);
+    int getIndex(int id) { return (id >= 0 && id < node_index.size()) ? node_index[id] : -1; }
+    void ensureRow(int src);
+    void writeMessageLine(int index, const int* hops, int length, OutputBuffer* out, OutputBuffer* console);
+    void invalidateRows(int a, int b, int old_w, int new_w);
 
    public:
-    BaseRouter(const char* topofile, const char* messagefile) {
-        g.clear();
-        dist.clear();
+    BaseRouter(const char* topofile, const char* messagefile, const char* snapshot = NULL, const char* kind = NULL,
+               bool compact = false)
+        : kind(kind), compact(compact) {
+        PROFILE_PHASE(PHASE_PARSE);
         num_nodes = 0;
-        readTopologyFile(topofile);
+        rows_computed = 0;
+        restored = snapshot != NULL && loadSnapshot(snapshot, topofile);
+        if (!restored) {
+            readTopologyFile(topofile);
+        }
         readMessageFile(messagefile);
     };
     virtual ~BaseRouter() {}
 
     void readTopologyFile(const char* filename);
     void readMessageFile(const char* filename);
-    void writeForwardingTable(int node, FILE* fp);
-    void writeMessage(int index, FILE* fp);
+    void writeForwardingTable(int node, OutputBuffer* out, OutputBuffer* console);
+    void writeForwardingTableDelta(int node, OutputBuffer* out);
+    void writeMessage(int index, OutputBuffer* out, OutputBuffer* console);
+    void writeMessages(OutputBuffer* out, OutputBuffer* console);
+
+    // Snapshots of the graph and the tables, see snapshot.cpp
+    bool saveSnapshot(const char* filename, const char* topofile);
+    bool loadSnapshot(const char* filename, const char* topofile);
+    bool isRestored() { return restored; }
 
     // Virtual function to be implemented by derived classes
     virtual void calculatePaths(int src) = 0;
+    // Compute everything the tables and messages read from the rows of src
+    virtual void calculateRow(int src) { calculatePaths(src); }
+    virtual void calculateAllPaths(ThreadPool& pool);
+
+    // Lazy mode: only the selected tables and the rows that messages go through are computed
+    bool selectTables(const char* list);
+    bool isLazy() { return !row_valid.empty(); }
+    bool isTableSelected(int node) { return selected.empty() || selected[node]; }
+    void calculateNeededRows(ThreadPool& pool);
+    int getRowsComputed() { return rows_computed; }
+
+    // ECMP mode: every equal-cost next hop is kept and printed, see ecmp.cpp
+    void calculateEcmp(ThreadPool& pool);
+    void buildEcmpTable(int src);
+    bool isEcmp() { return !ecmp_row.empty(); }
+    void getEcmpNextHops(int src, int dest, vector<int>& hops);
+    void getEcmpPath(int src, int dest, uint64_t flow, vector<int>& path);
+    uint64_t flowHash(int index);
+    void countEcmpRoutes(long long& multipath, long long& next_hops);
+
+    // Compact mode: rows are computed on the side and kept packed, without prev, see compact.cpp
+    bool isCompact() { return compact; }
+    double getTableMB();
 
     void buildForwardingTable(int src);
-    void printForwardingTable(int node);
-    void printMessage(int index);
-    vector<int> getPath(int src, int dest);
+    void getPath(int src, int dest, vector<int>& path);
 
     int getNumNodes() { return num_nodes; }
     int getNumMessages() { return messages.size(); }
-    int hasInput(int node) { return has_input[node]; }
+    int getNumLinks() { return g.numEdges(); }
+    int getNodeId(int node) { return node_id[node]; }
+    int getCost(int src, int dest) { return compact ? packed_dist[src].get(dest) : distRow(src)[dest]; }
+    int getNextHop(int src, int dest) {
+        if (!compact) return nextRow(src)[dest];
+        int port = packed_port[src].get(dest);
+        return (src == dest) ? src : (port == -1) ? -1 : g.neighbor(g.begin(src) + port);
+    }
+    bool hasNode(int id) { return getIndex(id) != -1; }
+    bool lookupRoute(int src_id, int dest_id, int& cost, int& next_hop_id, vector<int>* hop_ids);
 
     void addEdge(int u, int v, int w);
     void removeEdge(int u, int v);
     void updateEdge(int u, int v, int w);
+    int getEdgeWeight(int u, int v);
 };
 
-#endif
\ No newline at end of file
+#endif
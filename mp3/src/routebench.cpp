@@ -0,0 +1,527 @@
+/*
+ * Micro benchmarks for the mp3 routers.
+ * Usage: ./routebench parse [links]
+ *        ./routebench heap [nodes]
+ *        ./routebench sssp [nodes] [threads]
+ *        ./routebench tables [nodes]
+ *        ./routebench query unix:path|tcp:[host:]port topofile [queries] [depth]
+ *        ./routebench suite topofile messagefile changesfile [threads]
+ *        ./routebench suite --header
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+
+#include "distvec.hpp"
+#include "linkstate.hpp"
+#include "parser.hpp"
+#include "server.hpp"
+
+using namespace std;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// The scratch files in use, removed at the end of each benchmark, at exit or on a signal
+static const char* scratch_files[4];
+static volatile sig_atomic_t num_scratch_files = 0;
+
+// Create an empty file under $TMPDIR (or /tmp) into path, which must hold PATH_MAX bytes
+static int makeScratchFile(char* path, const char* name) {
+    const char* dir = getenv("TMPDIR");
+    snprintf(path, PATH_MAX, "%s/routebench_%s_XXXXXX", (dir != NULL && dir[0] != '\0') ? dir : "/tmp", name);
+    int fd = mkstemp(path);
+    scratch_files[num_scratch_files] = path;
+    num_scratch_files = num_scratch_files + 1;
+    return fd;
+}
+
+static void removeScratchFiles() {
+    for (int i = 0; i < num_scratch_files; i++) {
+        unlink(scratch_files[i]);
+    }
+    num_scratch_files = 0;
+}
+
+// Only calls unlink, so it is safe in a handler, then dies of the same signal
+static void removeScratchFilesOnSignal(int sig) {
+    removeScratchFiles();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static long long fileSize(const char* filename) {
+    FILE* fp = fopen(filename, "r");
+    if (fp == NULL) return 0;
+    fseek(fp, 0, SEEK_END);
+    long long size = ftell(fp);
+    fclose(fp);
+    return size;
+}
+
+// Write a random topology with the given number of links and one message per ten links
+static void generateParseInput(const char* topofile, const char* messagefile, int links) {
+    FILE* fp = fopen(topofile, "w");
+    int nodes = links / 4 + 2;
+    for (int i = 0; i < links; i++) {
+        fprintf(fp, "%d %d %d\n", rand() % nodes + 1, rand() % nodes + 1, rand() % 100 + 1);
+    }
+    fclose(fp);
+    fp = fopen(messagefile, "w");
+    for (int i = 0; i < links / 10; i++) {
+        fprintf(fp, "%d %d here is message number %d from the benchmark\n", rand() % nodes + 1, rand() % nodes + 1, i);
+    }
+    fclose(fp);
+}
+
+// The fscanf loops the routers used before the mapped parser
+static void legacyParse(const char* topofile, const char* messagefile, vector<Link>& links, vector<Message>& messages) {
+    FILE* fp = fopen(topofile, "r");
+    int u, v, w;
+    while (fscanf(fp, "%d %d %d", &u, &v, &w) != EOF) {
+        links.push_back({u, v, w});
+    }
+    fclose(fp);
+    fp = fopen(messagefile, "r");
+    int src, dest;
+    char text[100];
+    while (fscanf(fp, "%d %d %[^\n]", &src, &dest, text) != EOF) {
+        messages.push_back({src, dest, text});
+    }
+    fclose(fp);
+}
+
+// Parse throughput of fscanf against the mapped scanner on the same generated files
+static void benchParse(int links) {
+    char topofile[PATH_MAX], messagefile[PATH_MAX];
+    close(makeScratchFile(topofile, "topo"));
+    close(makeScratchFile(messagefile, "msg"));
+    generateParseInput(topofile, messagefile, links);
+    double mb = (fileSize(topofile) + fileSize(messagefile)) / 1e6;
+
+    vector<Link> legacy_links;
+    vector<Message> legacy_messages;
+    double start = now();
+    legacyParse(topofile, messagefile, legacy_links, legacy_messages);
+    double legacy = now() - start;
+
+    vector<Link> mapped_links;
+    vector<Message> mapped_messages;
+    start = now();
+    parseTopologyFile(topofile, mapped_links);
+    parseMessageFile(messagefile, mapped_messages);
+    double mapped = now() - start;
+
+    printf("parser,links,messages,MB,seconds,MB/s\n");
+    printf("fscanf,%zu,%zu,%.1f,%.3f,%.1f\n", legacy_links.size(), legacy_messages.size(), mb, legacy, mb / legacy);
+    printf("mmap,%zu,%zu,%.1f,%.3f,%.1f\n", mapped_links.size(), mapped_messages.size(), mb, mapped, mb / mapped);
+    removeScratchFiles();
+}
+
+// Write a connected random topology: a ring through every node plus extra random links of cost 1..max_weight
+static void generateGraph(const char* topofile, int nodes, long long links, int max_weight) {
+    FILE* fp = fopen(topofile, "w");
+    for (int i = 0; i < nodes; i++) {
+        fprintf(fp, "%d %d %d\n", i + 1, (i + 1) % nodes + 1, rand() % max_weight + 1);
+    }
+    for (long long i = nodes; i < links; i++) {
+        fprintf(fp, "%d %d %d\n", rand() % nodes + 1, rand() % nodes + 1, rand() % max_weight + 1);
+    }
+    fclose(fp);
+}
+
+// Hash of the cost and next hop rows of src
+static unsigned long long rowHash(LinkState& router, int src) {
+    unsigned long long hash = 14695981039346656037ULL;
+    router.buildForwardingTable(src);
+    for (int dest = 0; dest < router.getNumNodes(); dest++) {
+        hash = (hash ^ (unsigned)router.getCost(src, dest)) * 1099511628211ULL;
+        hash = (hash ^ (unsigned)router.getNextHop(src, dest)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Hash of the cost and next hop tables, to check that every heap gives the same routes
+static unsigned long long tableHash(LinkState& router) {
+    unsigned long long hash = 0;
+    for (int src = 0; src < router.getNumNodes(); src++) {
+        hash = hash * 31 + rowHash(router, src);
+    }
+    return hash;
+}
+
+// All-sources Dijkstra on one thread with every priority queue, on a sparse and a dense graph
+static void benchHeap(int nodes) {
+    const char* heaps[] = {"binary", "radix", "dial", "4ary"};
+    const char* graphs[] = {"sparse", "dense"};
+    char topofile[PATH_MAX], messagefile[PATH_MAX];
+    close(makeScratchFile(topofile, "topo"));
+    close(makeScratchFile(messagefile, "msg"));
+    ThreadPool pool(1);
+
+    printf("graph,nodes,links,heap,seconds,speedup\n");
+    for (const char* graph : graphs) {
+        long long links = (strcmp(graph, "sparse") == 0) ? 2LL * nodes : (long long)nodes * nodes / 8;
+        generateGraph(topofile, nodes, links, 20);
+        LinkState router(topofile, messagefile);
+        double binary = 0;
+        unsigned long long expected = 0;
+        for (const char* heap : heaps) {
+            router.setHeap(heap);
+            double start = now();
+            router.calculateAllPaths(pool);
+            double seconds = now() - start;
+            unsigned long long hash = tableHash(router);
+            if (strcmp(heap, "binary") == 0) {
+                binary = seconds;
+                expected = hash;
+            } else if (hash != expected) {
+                fprintf(stderr, "%s heap gives different routes than binary on the %s graph\n", heap, graph);
+            }
+            printf("%s,%d,%lld,%s,%.3f,%.2f\n", graph, router.getNumNodes(), links, heap, seconds, binary / seconds);
+        }
+    }
+    removeScratchFiles();
+}
+
+// Single-source time of Dijkstra against delta-stepping on a sparse graph, checking they give the same rows
+static void benchSssp(int nodes, int threads) {
+    const int sources = 16;
+    char topofile[PATH_MAX], messagefile[PATH_MAX];
+    close(makeScratchFile(topofile, "topo"));
+    close(makeScratchFile(messagefile, "msg"));
+    generateGraph(topofile, nodes, 4LL * nodes, 100);
+    LinkState router(topofile, messagefile);
+    ThreadPool pool(threads);
+
+    double dijkstra = 0;
+    double delta_stepping = 0;
+    for (int i = 0; i < sources; i++) {
+        int src = rand() % router.getNumNodes();
+        router.useDeltaStepping(NULL);
+        double start = now();
+        router.calculatePaths(src);
+        dijkstra += now() - start;
+        unsigned long long expected = rowHash(router, src);
+
+        router.useDeltaStepping(&pool);
+        start = now();
+        router.calculatePaths(src);
+        delta_stepping += now() - start;
+        if (rowHash(router, src) != expected) {
+            fprintf(stderr, "delta-stepping gives different routes than Dijkstra from node %d\n",
+                    router.getNodeId(src));
+        }
+    }
+    printf("engine,nodes,links,threads,sources,seconds\n");
+    printf("dijkstra,%d,%lld,1,%d,%.3f\n", router.getNumNodes(), 4LL * nodes, sources, dijkstra);
+    printf("delta-stepping,%d,%lld,%d,%d,%.3f\n", router.getNumNodes(), 4LL * nodes, threads, sources, delta_stepping);
+    removeScratchFiles();
+}
+
+// LinkState with the forwarding table construction the routers used before, for comparison
+class LegacyLinkState : public LinkState {
+   public:
+    LegacyLinkState(const char* topofile, const char* messagefile) : LinkState(topofile, messagefile) {}
+
+    // Walk the prev chain back to the source for every destination
+    void legacyForwardingTable(int src) {
+        int* d = distRow(src);
+        int* p = prevRow(src);
+        int* nh = nextRow(src);
+        for (int i = 0; i < num_nodes; i++) {
+            if (d[i] == INT_MAX) {
+                nh[i] = -1;
+            } else if (i == src) {
+                nh[i] = src;
+            } else if (p[i] == src) {
+                nh[i] = i;
+            } else {
+                int cur = p[i];
+                while (p[cur] != src) {
+                    cur = p[cur];
+                }
+                nh[i] = cur;
+            }
+        }
+    }
+};
+
+// Write a line (shape "line") or a complete binary tree (shape "tree") of unit cost links
+static void generateShape(const char* topofile, const char* shape, int nodes) {
+    FILE* fp = fopen(topofile, "w");
+    for (int i = 2; i <= nodes; i++) {
+        int parent = (strcmp(shape, "line") == 0) ? i - 1 : i / 2;
+        fprintf(fp, "%d %d 1\n", parent, i);
+    }
+    fclose(fp);
+}
+
+// Forwarding tables and message paths, chain walking against the single pass, on deep topologies
+static void benchTables(int nodes) {
+    const char* shapes[] = {"line", "tree"};
+    char topofile[PATH_MAX], messagefile[PATH_MAX];
+    close(makeScratchFile(topofile, "topo"));
+    close(makeScratchFile(messagefile, "msg"));
+    ThreadPool pool(1);
+    int null_fd = open("/dev/null", O_WRONLY);
+
+    printf("shape,nodes,messages,tables_legacy,tables_single_pass,messages_legacy,messages_shared\n");
+    for (const char* shape : shapes) {
+        generateShape(topofile, shape, nodes);
+        FILE* fp = fopen(messagefile, "w");
+        int num_messages = nodes;
+        for (int i = 0; i < num_messages; i++) {
+            fprintf(fp, "%d %d message %d\n", rand() % nodes + 1, rand() % nodes + 1, i);
+        }
+        fclose(fp);
+        LegacyLinkState router(topofile, messagefile);
+        router.calculateAllPaths(pool);
+
+        double start = now();
+        for (int src = 0; src < router.getNumNodes(); src++) router.legacyForwardingTable(src);
+        double legacy_tables = now() - start;
+        unsigned long long expected = tableHash(router);  // Rebuilds the tables with the single pass
+        start = now();
+        for (int src = 0; src < router.getNumNodes(); src++) router.buildForwardingTable(src);
+        double tables = now() - start;
+        for (int src = 0; src < router.getNumNodes(); src++) router.legacyForwardingTable(src);
+        if (tableHash(router) != expected) {
+            fprintf(stderr, "single pass gives different next hops than the chain walk on the %s\n", shape);
+        }
+
+        OutputBuffer out(null_fd);
+        start = now();
+        for (int i = 0; i < router.getNumMessages(); i++) router.writeMessage(i, &out, NULL);
+        out.flush();
+        double legacy_messages = now() - start;
+        start = now();
+        router.writeMessages(&out, NULL);
+        out.flush();
+        double messages = now() - start;
+        printf("%s,%d,%d,%.3f,%.3f,%.3f,%.3f\n", shape, nodes, num_messages, legacy_tables, tables,
+               legacy_messages, messages);
+    }
+    close(null_fd);
+    removeScratchFiles();
+}
+
+// Connect to a route server address, return the socket or -1
+static int connectTo(const char* address) {
+    int fd = -1;
+    if (strncmp(address, "unix:", 5) == 0) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, address + 5, sizeof(addr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+            close(fd);
+            return -1;
+        }
+    } else if (strncmp(address, "tcp:", 4) == 0) {
+        string host = "127.0.0.1";
+        const char* port = address + 4;
+        const char* colon = strrchr(port, ':');
+        if (colon != NULL) {
+            host = string(port, colon - port);
+            port = colon + 1;
+        }
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(port));
+        inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+static bool readFully(int fd, void* buffer, size_t length) {
+    char* p = (char*)buffer;
+    while (length > 0) {
+        ssize_t n = read(fd, p, length);
+        if (n <= 0) return false;
+        p += n;
+        length -= n;
+    }
+    return true;
+}
+
+/*
+ * Next hop lookups against a running server, depth requests in flight at a time.
+ * Latency is measured per batch of depth requests, from the first send to the last response.
+ */
+static void benchQuery(const char* address, const char* topofile, int queries, int depth) {
+    vector<Link> links;
+    if (!parseTopologyFile(topofile, links) || links.empty()) {
+        printf("Error opening file %s\n", topofile);
+        return;
+    }
+    int fd = connectTo(address);
+    if (fd == -1) {
+        printf("Cannot connect to %s\n", address);
+        return;
+    }
+    vector<RouteRequest> requests(depth);
+    vector<RouteResponse> responses(depth);
+    vector<double> latencies;
+    int unreachable = 0;
+    double start = now();
+    for (int sent = 0; sent < queries; sent += depth) {
+        int batch = min(depth, queries - sent);
+        for (int i = 0; i < batch; i++) {
+            memset(&requests[i], 0, sizeof(RouteRequest));
+            requests[i].op = OP_NEXT_HOP;
+            requests[i].id = sent + i;
+            requests[i].a = links[rand() % links.size()].u;
+            requests[i].b = links[rand() % links.size()].v;
+        }
+        double batch_start = now();
+        if (write(fd, requests.data(), batch * sizeof(RouteRequest)) != batch * sizeof(RouteRequest) ||
+            !readFully(fd, responses.data(), batch * sizeof(RouteResponse))) {
+            printf("Connection to %s broke\n", address);
+            close(fd);
+            return;
+        }
+        latencies.push_back(now() - batch_start);
+        for (int i = 0; i < batch; i++) {
+            if (responses[i].status != STATUS_OK) unreachable++;
+        }
+    }
+    double seconds = now() - start;
+    close(fd);
+    sort(latencies.begin(), latencies.end());
+    double sum = 0;
+    for (double latency : latencies) sum += latency;
+    printf("queries,depth,seconds,queries/s,avg_batch_us,p99_batch_us,not_ok\n");
+    printf("%d,%d,%.3f,%.0f,%.1f,%.1f,%d\n", queries, depth, seconds, queries / seconds,
+           sum / latencies.size() * 1e6, latencies[latencies.size() * 99 / 100] * 1e6, unreachable);
+}
+
+/*
+ * One full run of a router the way its main does it, timed by phase: parsing the
+ * inputs, computing every source, building the forwarding tables from prev (linkstate
+ * only, distvec gets its next hops out of the relaxation and compact linkstate builds
+ * them along with the paths), writing the first output, and then every change epoch
+ * end to end. The output goes to a scratch file.
+ */
+template <typename Make>
+static void benchRun(const char* name, Make make, const char* changesfile, int threads) {
+    ThreadPool pool(threads);
+    char outfile[PATH_MAX];
+    int fd = makeScratchFile(outfile, "out");
+    removeScratchFiles();  // Only written through fd
+    OutputBuffer out(fd);
+
+    double start = now();
+    auto router = make();
+    vector<vector<Change>> epochs;
+    RouterOptions opts;
+    if (!readChangeEpochs(changesfile, opts, epochs)) {
+        printf("Error opening file %s\n", changesfile);
+    }
+    double parsed = now();
+    router->calculateAllPaths(pool);
+    double paths = now();
+    bool tables = strcmp(name, "linkstate") == 0;
+    if (tables) {
+        pool.parallelFor(router->getNumNodes(), [&](int i) { router->buildForwardingTable(i); });
+    }
+    double built = now();
+    auto write = [&]() {
+        for (int i = 0; i < router->getNumNodes(); i++) {
+            router->writeForwardingTable(i, &out, NULL);
+        }
+        router->writeMessages(&out, NULL);
+        out.flush();
+    };
+    write();
+    double written = now();
+    for (auto& changes : epochs) {
+        for (auto& change : changes) {
+            router->updateEdge(change.u, change.v, change.w);
+        }
+        router->calculateAllPaths(pool);
+        if (tables) {
+            pool.parallelFor(router->getNumNodes(), [&](int i) { router->buildForwardingTable(i); });
+        }
+        write();
+    }
+    double done = now();
+
+    printf("%s,%d,%d,%d,%zu,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", name, router->getNumNodes(),
+           router->getNumLinks(), router->getNumMessages(), epochs.size(), threads, parsed - start, paths - parsed,
+           built - paths, written - built, done - written, done - start);
+    fflush(stdout);
+    delete router;
+    close(fd);
+}
+
+// Time the routers on the same input files, one CSV line each, linkstate also with compact tables
+static const char* SUITE_HEADER = "router,nodes,links,messages,changes,threads,parse_s,paths_s,tables_s,output_s,changes_s,total_s";
+
+static void benchSuite(const char* topofile, const char* messagefile, const char* changesfile, int threads) {
+    printf("%s\n", SUITE_HEADER);
+    benchRun("linkstate", [&]() { return new LinkState(topofile, messagefile); }, changesfile, threads);
+    benchRun("linkstate-compact", [&]() { return new LinkState(topofile, messagefile, NULL, true); }, changesfile,
+             threads);
+    benchRun("distvec", [&]() { return new DistanceVector(topofile, messagefile, true); }, changesfile, threads);
+}
+
+int main(int argc, char** argv) {
+    atexit(removeScratchFiles);
+    for (int sig : {SIGINT, SIGTERM, SIGHUP, SIGPIPE}) {
+        signal(sig, removeScratchFilesOnSignal);
+    }
+    if (argc >= 2 && strcmp(argv[1], "parse") == 0) {
+        benchParse(argc >= 3 ? atoi(argv[2]) : 5000000);
+        return 0;
+    }
+    if (argc >= 2 && strcmp(argv[1], "heap") == 0) {
+        benchHeap(argc >= 3 ? atoi(argv[2]) : 2000);
+        return 0;
+    }
+    if (argc >= 2 && strcmp(argv[1], "sssp") == 0) {
+        benchSssp(argc >= 3 ? atoi(argv[2]) : 5000, argc >= 4 ? atoi(argv[3]) : 4);
+        return 0;
+    }
+    if (argc >= 2 && strcmp(argv[1], "tables") == 0) {
+        benchTables(argc >= 3 ? atoi(argv[2]) : 4000);
+        return 0;
+    }
+    if (argc >= 4 && strcmp(argv[1], "query") == 0) {
+        benchQuery(argv[2], argv[3], argc >= 5 ? atoi(argv[4]) : 100000, argc >= 6 ? max(atoi(argv[5]), 1) : 1);
+        return 0;
+    }
+    if (argc == 3 && strcmp(argv[1], "suite") == 0 && strcmp(argv[2], "--header") == 0) {
+        // Only the CSV header, for scripts starting a results file
+        printf("%s\n", SUITE_HEADER);
+        return 0;
+    }
+    if (argc >= 5 && strcmp(argv[1], "suite") == 0) {
+        benchSuite(argv[2], argv[3], argv[4], argc >= 6 ? max(atoi(argv[5]), 1) : 1);
+        return 0;
+    }
+    printf("Usage: ./routebench parse [links] | heap [nodes] | sssp [nodes] [threads] | tables [nodes] | query address topofile [queries] [depth] | suite topofile messagefile changesfile [threads] | suite --header\n");
+    return -1;
+}
@@ -0,0 +1,270 @@
+#include "server.hpp"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <string>
+
+// Responses a connection may have waiting, a client that sends past this without reading is dropped
+static const size_t MAX_PENDING_OUTPUT = 16 << 20;
+
+// Listen on the address, return the listening socket or -1
+int RouteServer::listenOn(const char *address) {
+    int fd = -1;
+    if (strncmp(address, "unix:", 5) == 0) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(address + 5) == 0 || strlen(address + 5) >= sizeof(addr.sun_path)) {
+            return -1;
+        }
+        strcpy(addr.sun_path, address + 5);
+        unlink(addr.sun_path);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (fd == -1 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+            perror("bind");
+            if (fd != -1) ::close(fd);
+            return -1;
+        }
+    } else if (strncmp(address, "tcp:", 4) == 0) {
+        // tcp:<port> listens on the loopback interface only
+        string host = "127.0.0.1";
+        const char *port = address + 4;
+        const char *colon = strrchr(port, ':');
+        if (colon != NULL) {
+            host = string(port, colon - port);
+            port = colon + 1;
+        }
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(port));
+        if (atoi(port) <= 0 || atoi(port) > 65535 || inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+            return -1;
+        }
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        int yes = 1;
+        if (fd != -1) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        if (fd == -1 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+            perror("bind");
+            if (fd != -1) ::close(fd);
+            return -1;
+        }
+    } else {
+        return -1;
+    }
+    if (listen(fd, 128) == -1) {
+        perror("listen");
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool RouteServer::run(const char *address) {
+    int listen_fd = listenOn(address);
+    if (listen_fd == -1) {
+        return false;
+    }
+    epfd = epoll_create1(0);
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = listen_fd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev);
+    fprintf(stderr, "[*] Serving routes on %s\n", address);
+
+    struct epoll_event events[64];
+    stopping = false;
+    while (!stopping) {
+        int n = epoll_wait(epfd, events, 64, -1);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listen_fd) {
+                acceptAll(listen_fd);
+                continue;
+            }
+            auto it = connections.find(fd);
+            if (it == connections.end()) continue;
+            Connection &conn = it->second;
+            if (events[i].events & EPOLLERR) {
+                drop(fd);
+                continue;
+            }
+            if ((events[i].events & (EPOLLIN | EPOLLHUP)) && !conn.closing && !readRequests(fd, conn)) {
+                conn.closing = true;
+            }
+            if (conn.out.size() - conn.out_pos > MAX_PENDING_OUTPUT) {
+                // Also the only way readRequests leaves requests unanswered
+                fprintf(stderr, "[*] Dropping a client with %zu bytes of unread responses\n",
+                        conn.out.size() - conn.out_pos);
+                drop(fd);
+            } else if (!flush(fd, conn) || (conn.closing && conn.out.empty())) {
+                drop(fd);
+            }
+        }
+    }
+
+    // Write out what was answered before OP_SHUTDOWN as far as the socket buffers take it,
+    // a client that is not reading loses the rest rather than holding up the shutdown
+    for (auto &entry : connections) {
+        flush(entry.first, entry.second);
+        ::close(entry.first);
+    }
+    connections.clear();
+    ::close(listen_fd);
+    ::close(epfd);
+    if (strncmp(address, "unix:", 5) == 0) {
+        unlink(address + 5);
+    }
+    return true;
+}
+
+void RouteServer::acceptAll(int listen_fd) {
+    while (true) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK);
+        if (fd == -1) {
+            return;
+        }
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));  // Fails harmlessly on Unix sockets
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+        connections[fd];
+    }
+}
+
+/*
+ * Read everything available and answer every whole request in it, in order, leaving
+ * the rest unanswered once more than MAX_PENDING_OUTPUT bytes wait to be written.
+ * Return false once the client closed its side of the connection.
+ */
+bool RouteServer::readRequests(int fd, Connection &conn) {
+    char buffer[65536];
+    bool open = true;
+    while (true) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            conn.in.insert(conn.in.end(), buffer, buffer + n);
+            continue;
+        }
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n == -1 && errno == EINTR) continue;
+        open = false;  // EOF or error, still answer what arrived
+        break;
+    }
+    size_t used = 0;
+    while (conn.in.size() - used >= sizeof(RouteRequest) && conn.out.size() - conn.out_pos <= MAX_PENDING_OUTPUT) {
+        RouteRequest req;
+        memcpy(&req, conn.in.data() + used, sizeof(req));
+        used += sizeof(req);
+        answer(req, conn);
+    }
+    conn.in.erase(conn.in.begin(), conn.in.begin() + used);
+    return open;
+}
+
+// Append the response to one request to the output of the connection
+void RouteServer::answer(const RouteRequest &req, Connection &conn) {
+    RouteResponse resp;
+    resp.id = req.id;
+    resp.status = STATUS_OK;
+    resp.cost = -1;
+    resp.next_hop = -1;
+    resp.count = 0;
+    switch (req.op) {
+        case OP_NEXT_HOP:
+        case OP_PATH:
+            if (!router.hasNode(req.a) || !router.hasNode(req.b)) {
+                resp.status = STATUS_UNKNOWN_NODE;
+            } else if (!router.lookupRoute(req.a, req.b, resp.cost, resp.next_hop,
+                                           req.op == OP_PATH ? &path : NULL)) {
+                resp.status = STATUS_UNREACHABLE;
+            } else if (req.op == OP_PATH) {
+                resp.count = path.size();
+            }
+            break;
+        case OP_CHANGE:
+            if (!router.hasNode(req.a) || !router.hasNode(req.b)) {
+                resp.status = STATUS_UNKNOWN_NODE;
+            } else if (req.c < 0 && req.c != -999) {
+                resp.status = STATUS_BAD_REQUEST;
+            } else {
+                apply({req.a, req.b, req.c});
+            }
+            break;
+        case OP_SHUTDOWN:
+            stopping = true;
+            break;
+        default:
+            resp.status = STATUS_BAD_REQUEST;
+            break;
+    }
+    const char *bytes = (const char *)&resp;
+    conn.out.insert(conn.out.end(), bytes, bytes + sizeof(resp));
+    if (resp.count > 0) {
+        const char *hops = (const char *)path.data();
+        conn.out.insert(conn.out.end(), hops, hops + resp.count * sizeof(int32_t));
+    }
+}
+
+/*
+ * Write as much pending output as the socket takes, then drop what was written once
+ * it is most of out. epoll only waits for EPOLLOUT while some is left, and no
+ * longer for EPOLLIN once the client is closing.
+ * Return false if the connection broke.
+ */
+bool RouteServer::flush(int fd, Connection &conn) {
+    while (conn.out_pos < conn.out.size()) {
+        ssize_t n = send(fd, conn.out.data() + conn.out_pos, conn.out.size() - conn.out_pos, MSG_NOSIGNAL);
+        if (n > 0) {
+            conn.out_pos += n;
+            continue;
+        }
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        return false;
+    }
+    bool pending = conn.out_pos < conn.out.size();
+    if (!pending) {
+        conn.out.clear();
+        conn.out_pos = 0;
+    } else if (conn.out_pos >= conn.out.size() / 2) {
+        // Drop the written half, so a client reading steadily behind its requests keeps out bounded
+        conn.out.erase(conn.out.begin(), conn.out.begin() + conn.out_pos);
+        conn.out_pos = 0;
+    }
+    uint32_t events = (conn.closing ? 0u : (uint32_t)EPOLLIN) | (pending ? (uint32_t)EPOLLOUT : 0u);
+    if (events != conn.events) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = events;
+        ev.data.fd = fd;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+        conn.events = events;
+    }
+    return true;
+}
+
+void RouteServer::drop(int fd) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+    ::close(fd);
+    connections.erase(fd);
+}
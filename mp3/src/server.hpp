@@ -0,0 +1,91 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "route.hpp"
+
+using namespace std;
+
+/*
+ * Wire format of the route query protocol, in host byte order.
+ * A client sends fixed-size requests and may send many of them without waiting.
+ * The server answers every request in order with a fixed-size response, which
+ * for OP_PATH is followed by count int32 hops.
+ */
+enum RouteOp : uint8_t {
+    OP_NEXT_HOP = 1,  // a = source, b = destination -> cost, next_hop
+    OP_PATH = 2,      // a = source, b = destination -> cost, count hops as written in output.txt
+    OP_CHANGE = 3,    // a, b = ends of the link, c = new cost or -999 to remove it
+    OP_SHUTDOWN = 4,  // Stop the server once the responses so far are written
+};
+
+enum RouteStatus : int32_t {
+    STATUS_OK = 0,
+    STATUS_UNREACHABLE = 1,
+    STATUS_UNKNOWN_NODE = 2,
+    STATUS_BAD_REQUEST = 3,
+};
+
+struct RouteRequest {
+    uint8_t op;       // RouteOp
+    uint8_t pad[3];
+    uint32_t id;      // Echoed back in the response
+    int32_t a;
+    int32_t b;
+    int32_t c;
+};
+
+struct RouteResponse {
+    uint32_t id;       // id of the request
+    int32_t status;    // RouteStatus
+    int32_t cost;      // Cost of the route, -1 if there is none
+    int32_t next_hop;  // Next hop node ID, -1 if there is none
+    uint32_t count;    // Number of int32 hops following the response
+};
+
+/*
+ * Single-threaded epoll server answering route queries from a resident router.
+ * Link changes go through apply, which updates the router tables before the
+ * next request of any connection is answered.
+ */
+class RouteServer {
+   public:
+    RouteServer(BaseRouter& router, const function<void(const Change&)>& apply) : router(router), apply(apply) {}
+
+    /*
+     * Listen on "unix:<path>" or "tcp:[<host>:]<port>" and serve until OP_SHUTDOWN.
+     * Return false if the address is malformed or cannot be listened on.
+     */
+    bool run(const char* address);
+
+   private:
+    struct Connection {
+        vector<char> in;   // Bytes received, not yet a whole request
+        vector<char> out;  // Responses not written yet
+        size_t out_pos = 0;
+        uint32_t events = EPOLLIN;  // Events epoll waits for on the connection
+        bool closing = false;      // The client is done sending, drop it once out is written
+    };
+
+    BaseRouter& router;
+    function<void(const Change&)> apply;
+    unordered_map<int, Connection> connections;
+    vector<int> path;  // Scratch hops of OP_PATH
+    int epfd = -1;
+    bool stopping = false;
+
+    int listenOn(const char* address);
+    void acceptAll(int listen_fd);
+    bool readRequests(int fd, Connection& conn);
+    void answer(const RouteRequest& req, Connection& conn);
+    bool flush(int fd, Connection& conn);
+    void drop(int fd);
+};
+
+#endif
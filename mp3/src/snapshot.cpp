@@ -0,0 +1,198 @@
+/*
+ * Binary snapshots of the routing state, so that a restart on an unchanged
+ * topology does not have to parse it and run every source again.
+ *
+ * Layout, in host byte order:
+ *   SnapshotHeader
+ *   node_id                 num_nodes ints
+ *   graph offsets           num_nodes + 1 ints
+ *   graph degrees           num_nodes ints
+ *   graph neighbors         capacity ints
+ *   graph weights           capacity ints
+ *   dist, prev, next        num_nodes * num_nodes ints each
+ *
+ * The header carries the FNV-1a hash of the topology file bytes. A snapshot
+ * whose hash, version or router does not match is ignored and the router
+ * falls back to parsing the topology file. So is one whose contents are not
+ * consistent, since a damaged file must not send the router out of bounds.
+ *
+ * The tables are copied out of the mapping rather than used in place: the
+ * router owns them as vectors and rewrites them on every change epoch. The copy
+ * is one pass over N^2 ints, where recomputing them is N runs of Dijkstra.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "route.hpp"
+
+static const char SNAPSHOT_MAGIC[8] = {'M', 'P', '3', 'S', 'N', 'A', 'P', '\0'};
+static const uint32_t SNAPSHOT_VERSION = 1;
+
+struct SnapshotHeader {
+    char magic[8];           // SNAPSHOT_MAGIC
+    uint32_t version;        // SNAPSHOT_VERSION
+    char kind[12];           // Router that computed the tables, e.g. "linkstate"
+    uint64_t topology_hash;  // FNV-1a hash of the topology file
+    int32_t num_nodes;       // Number of dense indices
+    int32_t num_edges;       // Number of links in the graph
+    int32_t capacity;        // Length of the graph neighbor and weight arrays
+    int32_t reserved;
+};
+
+// FNV-1a hash of the whole file, return false if it cannot be opened
+static bool hashFile(const char* filename, uint64_t& hash) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        return false;
+    }
+    hash = 14695981039346656037ULL;
+    for (const char* p = file.begin(); p < file.end(); p++) {
+        hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+    }
+    return true;
+}
+
+// Every entry is a dense index below n, or -1 where allowed
+static bool validIndices(const vector<int>& v, int n, bool allow_none) {
+    for (int x : v) {
+        if (x >= n || x < (allow_none ? -1 : 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Check what the router later indexes with: node IDs in increasing order up to
+ * MAX_NODE_ID, rows that start at 0, do not overlap and end within capacity,
+ * neighbors below n, and as many links as the rows hold.
+ */
+static bool validGraph(int n, int capacity, int num_edges, const vector<int>& node_id, const vector<int>& offsets,
+                       const vector<int>& degrees, const vector<int>& neighbors) {
+    for (int i = 0; i < n; i++) {
+        if (node_id[i] < 0 || node_id[i] > MAX_NODE_ID || (i > 0 && node_id[i] <= node_id[i - 1])) {
+            return false;
+        }
+    }
+    if (offsets[0] != 0 || offsets[n] > capacity) {
+        return false;
+    }
+    long long ends = 0;  // Each link is in the rows of both its ends
+    for (int u = 0; u < n; u++) {
+        if (degrees[u] < 0 || offsets[u + 1] < offsets[u] || degrees[u] > offsets[u + 1] - offsets[u]) {
+            return false;
+        }
+        for (int e = offsets[u]; e < offsets[u] + degrees[u]; e++) {
+            if (neighbors[e] < 0 || neighbors[e] >= n) {
+                return false;
+            }
+        }
+        ends += degrees[u];
+    }
+    return ends == 2LL * num_edges;
+}
+
+static bool writeInts(FILE* fp, const vector<int>& v) {
+    return fwrite(v.data(), sizeof(int), v.size(), fp) == v.size();
+}
+
+// Copy count ints out of the mapped snapshot, return false if the snapshot is too short
+static bool readInts(const char*& pos, const char* end, vector<int>& v, size_t count) {
+    if ((size_t)(end - pos) / sizeof(int) < count) {
+        return false;
+    }
+    v.resize(count);
+    memcpy(v.data(), pos, count * sizeof(int));
+    pos += count * sizeof(int);
+    return true;
+}
+
+/*
+ * Save the graph and the tables computed for topofile.
+ * The snapshot is written next to filename and renamed over it, so a crash
+ * never leaves a half-written snapshot behind.
+ */
+bool BaseRouter::saveSnapshot(const char* filename, const char* topofile) {
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    if (kind == NULL || !hashFile(topofile, header.topology_hash)) {
+        return false;
+    }
+    strncpy(header.kind, kind, sizeof(header.kind) - 1);
+    header.num_nodes = num_nodes;
+    header.num_edges = g.numEdges();
+    header.capacity = g.getNeighbors().size();
+
+    string tmpname = string(filename) + ".tmp";
+    FILE* fp = fopen(tmpname.c_str(), "wb");
+    if (fp == NULL) {
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 && writeInts(fp, node_id) &&
+              writeInts(fp, g.getOffsets()) && writeInts(fp, g.getDegrees()) && writeInts(fp, g.getNeighbors()) &&
+              writeInts(fp, g.getWeights()) && writeInts(fp, dist) && writeInts(fp, prev) && writeInts(fp, next);
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tmpname.c_str(), filename) != 0) {
+        remove(tmpname.c_str());
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Restore the graph and the tables from a snapshot of topofile.
+ * Return false, leaving the router empty, if the snapshot is missing, corrupt,
+ * written by another version or router, or taken from a different topology.
+ */
+bool BaseRouter::loadSnapshot(const char* filename, const char* topofile) {
+    MappedFile file;
+    uint64_t hash;
+    if (kind == NULL || !file.open(filename) || !hashFile(topofile, hash)) {
+        return false;
+    }
+    const char* pos = file.begin();
+    const char* end = file.end();
+    SnapshotHeader header;
+    if (file.size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, pos, sizeof(header));
+    pos += sizeof(header);
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.version != SNAPSHOT_VERSION ||
+        strncmp(header.kind, kind, sizeof(header.kind)) != 0 || header.topology_hash != hash ||
+        header.num_nodes < 0 || header.capacity < 0 || header.num_edges < 0) {
+        return false;
+    }
+
+    // The sections must add up to the file length exactly, checked before anything is allocated
+    int n = header.num_nodes;
+    size_t cells = (size_t)n * n;
+    size_t ints = 3 * (size_t)n + 1 + 2 * (size_t)header.capacity;
+    size_t available = (file.size() - sizeof(header)) / sizeof(int);
+    if (cells > available / 3 || ints + 3 * cells != available || (file.size() - sizeof(header)) % sizeof(int) != 0) {
+        return false;
+    }
+    vector<int> offsets, degrees, neighbors, weights;
+    if (!readInts(pos, end, node_id, n) || !readInts(pos, end, offsets, n + 1) || !readInts(pos, end, degrees, n) ||
+        !readInts(pos, end, neighbors, header.capacity) || !readInts(pos, end, weights, header.capacity) ||
+        !readInts(pos, end, dist, cells) || !readInts(pos, end, prev, cells) || !readInts(pos, end, next, cells) ||
+        pos != end || !validGraph(n, header.capacity, header.num_edges, node_id, offsets, degrees, neighbors) ||
+        !validIndices(prev, n, true) || !validIndices(next, n, true)) {
+        node_id.clear();
+        dist.clear();
+        prev.clear();
+        next.clear();
+        return false;
+    }
+
+    g.restore(n, header.num_edges, offsets, degrees, neighbors, weights);
+    num_nodes = n;
+    node_index.assign(n > 0 ? node_id[n - 1] + 1 : 1, -1);
+    for (int i = 0; i < n; i++) {
+        node_index[node_id[i]] = i;
+    }
+    return true;
+}
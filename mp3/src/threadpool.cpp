@@ -0,0 +1,114 @@
+#include "threadpool.hpp"
+
+ThreadPool::ThreadPool(int num_threads) : job(nullptr), pending(0), generation(0), stop(false) {
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    for (int i = 0; i < num_threads; i++) {
+        workers.emplace_back(new Worker());
+    }
+    for (int i = 1; i < num_threads; i++) {
+        threads.emplace_back(&ThreadPool::threadMain, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> guard(lock);
+        stop = true;
+    }
+    start_cv.notify_all();
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+void ThreadPool::parallelFor(int n, const function<void(int)>& fn) {
+    if (n <= 0) {
+        return;
+    }
+    if (workers.size() == 1) {
+        for (int i = 0; i < n; i++) {
+            fn(i);
+        }
+        return;
+    }
+
+    // Deal out small ranges round-robin, so that stealing can even out uneven sources
+    int num_workers = workers.size();
+    int grain = n / (num_workers * 8);
+    if (grain < 1) {
+        grain = 1;
+    }
+    int num_ranges = (n + grain - 1) / grain;
+    job = &fn;
+    pending = num_ranges;
+    for (int r = 0; r < num_ranges; r++) {
+        Worker& worker = *workers[r % num_workers];
+        lock_guard<mutex> guard(worker.lock);
+        worker.ranges.push_back({r * grain, min(n, (r + 1) * grain)});
+    }
+    {
+        lock_guard<mutex> guard(lock);
+        generation++;
+    }
+    start_cv.notify_all();
+
+    runRanges(0);
+
+    unique_lock<mutex> guard(lock);
+    done_cv.wait(guard, [this] { return pending == 0; });
+}
+
+// Pop a range from the back of our own deque, or steal one from the front of another
+bool ThreadPool::takeRange(int id, pair<int, int>& range) {
+    {
+        Worker& own = *workers[id];
+        lock_guard<mutex> guard(own.lock);
+        if (!own.ranges.empty()) {
+            range = own.ranges.back();
+            own.ranges.pop_back();
+            return true;
+        }
+    }
+    for (int i = 1; i < workers.size(); i++) {
+        Worker& victim = *workers[(id + i) % workers.size()];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.ranges.empty()) {
+            range = victim.ranges.front();
+            victim.ranges.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+// Run ranges until there is nothing left to take
+void ThreadPool::runRanges(int id) {
+    pair<int, int> range;
+    while (takeRange(id, range)) {
+        const function<void(int)>& fn = *job;
+        for (int i = range.first; i < range.second; i++) {
+            fn(i);
+        }
+        if (--pending == 0) {
+            lock_guard<mutex> guard(lock);
+            done_cv.notify_all();
+        }
+    }
+}
+
+void ThreadPool::threadMain(int id) {
+    int seen = 0;
+    while (true) {
+        {
+            unique_lock<mutex> guard(lock);
+            start_cv.wait(guard, [&] { return stop || generation != seen; });
+            if (stop) {
+                return;
+            }
+            seen = generation;
+        }
+        runRanges(id);
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Fixed set of worker threads for data-parallel loops.
+ * Every worker owns a deque of index ranges: it pops work from the back of its own
+ * deque and, once that is empty, steals from the front of the other workers' deques.
+ * The thread calling parallelFor works as worker 0, so a pool of size 1 runs inline.
+ */
+class ThreadPool {
+   public:
+    explicit ThreadPool(int num_threads);
+    ~ThreadPool();
+
+    // Run fn(i) for every i in [0, n) and return once all of them are done
+    void parallelFor(int n, const function<void(int)>& fn);
+
+    int size() { return workers.size(); }
+
+   private:
+    struct Worker {
+        mutex lock;
+        deque<pair<int, int>> ranges;  // [begin, end) index ranges still to run
+    };
+
+    vector<unique_ptr<Worker>> workers;
+    vector<thread> threads;
+    const function<void(int)>* job;  // Loop body of the current parallelFor
+    atomic<int> pending;             // Ranges of the current parallelFor not finished yet
+
+    mutex lock;
+    condition_variable start_cv;  // Signals a new parallelFor (or shutdown) to the threads
+    condition_variable done_cv;   // Signals the caller that pending dropped to zero
+    int generation;               // Number of parallelFor calls so far
+    bool stop;
+
+    bool takeRange(int id, pair<int, int>& range);
+    void runRanges(int id);
+    void threadMain(int id);
+};
+
+#endif
@@ -0,0 +1,258 @@
+/*
+ * Synthetic inputs for the mp3 routers.
+ * Usage: ./topogen geometric|ba|grid|fattree nodes outdir [messages] [changes] [seed] [max_cost]
+ * Writes outdir/topofile, outdir/messagefile and outdir/changesfile.
+ *
+ * geometric  random points in the unit square, linked when closer than the connectivity
+ *            radius, with costs growing with the distance
+ * ba         Barabasi-Albert preferential attachment, 3 links per new node
+ * grid       square grid with 4 neighbors per node
+ * fattree    k-ary fat tree, the smallest even k with at least the given number of nodes,
+ *            every link of cost 1 so that shortest paths tie everywhere
+ *
+ * Node IDs are a random permutation of 1..nodes, so routers cannot rely on them being in order.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+struct Edge {
+    int u;
+    int v;
+    int w;
+};
+
+static mt19937 rng;
+
+static int randInt(int lo, int hi) { return uniform_int_distribution<int>(lo, hi)(rng); }
+
+// Points in the unit square, linked to every point within radius, found through a grid of radius-sized cells
+static void generateGeometric(int n, int max_cost, vector<Edge>& edges) {
+    double radius = sqrt(2.0 * log((double)max(n, 2)) / (M_PI * n));
+    int cells = max(1, (int)(1.0 / radius));
+    vector<double> x(n), y(n);
+    vector<vector<int>> grid(cells * cells);
+    uniform_real_distribution<double> unit(0.0, 1.0);
+    for (int i = 0; i < n; i++) {
+        x[i] = unit(rng);
+        y[i] = unit(rng);
+        grid[min((int)(y[i] * cells), cells - 1) * cells + min((int)(x[i] * cells), cells - 1)].push_back(i);
+    }
+    for (int cy = 0; cy < cells; cy++) {
+        for (int cx = 0; cx < cells; cx++) {
+            for (int a : grid[cy * cells + cx]) {
+                // Look at this cell and the half of the neighboring cells after it
+                for (int dy = 0; dy <= 1; dy++) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        if (dy == 0 && dx < 0) continue;
+                        int ny = cy + dy, nx = cx + dx;
+                        if (nx < 0 || nx >= cells || ny >= cells) continue;
+                        for (int b : grid[ny * cells + nx]) {
+                            if (dy == 0 && dx == 0 && b <= a) continue;
+                            double d = hypot(x[a] - x[b], y[a] - y[b]);
+                            if (d <= radius) {
+                                edges.push_back({a, b, 1 + (int)(d / radius * (max_cost - 1))});
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    // Link the few points left without a neighbor to the nearest point, so every node is in the topology
+    vector<int> degree(n, 0);
+    for (const Edge& e : edges) {
+        degree[e.u]++;
+        degree[e.v]++;
+    }
+    for (int a = 0; a < n; a++) {
+        if (degree[a] > 0) continue;
+        int nearest = (a == 0) ? 1 : 0;
+        for (int b = 0; b < n; b++) {
+            if (b != a && hypot(x[a] - x[b], y[a] - y[b]) < hypot(x[a] - x[nearest], y[a] - y[nearest])) nearest = b;
+        }
+        edges.push_back({a, nearest, max_cost});
+        degree[a]++;
+        degree[nearest]++;
+    }
+}
+
+// Each new node links to 3 distinct earlier nodes picked with probability proportional to their degree
+static void generateBarabasiAlbert(int n, int max_cost, vector<Edge>& edges) {
+    const int m = 3;
+    vector<int> endpoints;  // Every node once per link end, so a uniform pick follows the degree
+    int core = min(n, m + 1);
+    for (int a = 0; a < core; a++) {
+        for (int b = a + 1; b < core; b++) {
+            edges.push_back({a, b, randInt(1, max_cost)});
+            endpoints.push_back(a);
+            endpoints.push_back(b);
+        }
+    }
+    for (int v = core; v < n; v++) {
+        int targets[m];
+        int found = 0;
+        while (found < m) {
+            int t = endpoints[randInt(0, endpoints.size() - 1)];
+            if (find(targets, targets + found, t) == targets + found) targets[found++] = t;
+        }
+        for (int i = 0; i < m; i++) {
+            edges.push_back({v, targets[i], randInt(1, max_cost)});
+            endpoints.push_back(v);
+            endpoints.push_back(targets[i]);
+        }
+    }
+}
+
+// side x side grid with side the smallest one holding n nodes, the last row may be partial
+static void generateGrid(int n, int max_cost, vector<Edge>& edges) {
+    int side = (int)ceil(sqrt((double)n));
+    for (int i = 0; i < n; i++) {
+        if ((i + 1) % side != 0 && i + 1 < n) edges.push_back({i, i + 1, randInt(1, max_cost)});
+        if (i + side < n) edges.push_back({i, i + side, randInt(1, max_cost)});
+    }
+}
+
+/*
+ * k-ary fat tree: (k/2)^2 core switches, k pods of k/2 aggregation and k/2 edge
+ * switches, and k/2 hosts under each edge switch. Return the number of nodes.
+ */
+static int generateFatTree(int n, vector<Edge>& edges) {
+    int k = 2;
+    while (5 * k * k / 4 + k * k * k / 4 < n) k += 2;
+    int half = k / 2;
+    int core = half * half;
+    int aggregation = core;                     // First aggregation switch
+    int edge = aggregation + k * half;          // First edge switch
+    int host = edge + k * half;                 // First host
+    for (int pod = 0; pod < k; pod++) {
+        for (int i = 0; i < half; i++) {
+            int agg = aggregation + pod * half + i;
+            for (int j = 0; j < half; j++) {
+                edges.push_back({agg, i * half + j, 1});             // Up to the cores of group i
+                edges.push_back({agg, edge + pod * half + j, 1});    // Down to every edge switch of the pod
+            }
+        }
+        for (int j = 0; j < half; j++) {
+            int sw = edge + pod * half + j;
+            for (int h = 0; h < half; h++) {
+                edges.push_back({sw, host + (pod * half + j) * half + h, 1});
+            }
+        }
+    }
+    return host + k * k * k / 4;
+}
+
+/*
+ * Changes on the generated links: mostly new costs, some removals, and
+ * restorations of links removed earlier so the topology does not only shrink.
+ */
+static void generateChanges(const vector<Edge>& edges, int count, int max_cost, vector<Edge>& changes) {
+    vector<Edge> removed;
+    set<pair<int, int>> gone;
+    for (int i = 0; i < count && !edges.empty(); i++) {
+        int kind = randInt(0, 99);
+        if (kind < 15 && !removed.empty()) {
+            int r = randInt(0, removed.size() - 1);
+            Edge e = removed[r];
+            removed[r] = removed.back();
+            removed.pop_back();
+            gone.erase({e.u, e.v});
+            changes.push_back({e.u, e.v, randInt(1, max_cost)});
+            continue;
+        }
+        Edge e = edges[randInt(0, edges.size() - 1)];
+        if (gone.count({e.u, e.v})) {
+            i--;
+            continue;
+        }
+        if (kind < 30) {
+            removed.push_back(e);
+            gone.insert({e.u, e.v});
+            changes.push_back({e.u, e.v, -999});
+        } else {
+            changes.push_back({e.u, e.v, randInt(1, max_cost)});
+        }
+    }
+}
+
+static bool writeEdges(const string& filename, const vector<Edge>& edges, const vector<int>& id) {
+    FILE* fp = fopen(filename.c_str(), "w");
+    if (fp == NULL) {
+        return false;
+    }
+    for (const Edge& e : edges) {
+        fprintf(fp, "%d %d %d\n", id[e.u], id[e.v], e.w);
+    }
+    return fclose(fp) == 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        printf("Usage: ./topogen geometric|ba|grid|fattree nodes outdir [messages] [changes] [seed] [max_cost]\n");
+        return -1;
+    }
+    const char* shape = argv[1];
+    int n = atoi(argv[2]);
+    string dir = argv[3];
+    int num_messages = argc >= 5 ? atoi(argv[4]) : max(1, n / 10);
+    int num_changes = argc >= 6 ? atoi(argv[5]) : 10;
+    rng.seed(argc >= 7 ? atoi(argv[6]) : 1);
+    int max_cost = argc >= 8 ? max(atoi(argv[7]), 1) : 100;
+    if (n < 2) {
+        printf("Need at least 2 nodes\n");
+        return -1;
+    }
+
+    vector<Edge> edges;
+    if (strcmp(shape, "geometric") == 0) {
+        generateGeometric(n, max_cost, edges);
+    } else if (strcmp(shape, "ba") == 0) {
+        generateBarabasiAlbert(n, max_cost, edges);
+    } else if (strcmp(shape, "grid") == 0) {
+        generateGrid(n, max_cost, edges);
+    } else if (strcmp(shape, "fattree") == 0) {
+        n = generateFatTree(n, edges);
+        max_cost = 1;
+    } else {
+        printf("Unknown shape %s, expected geometric, ba, grid or fattree\n", shape);
+        return -1;
+    }
+
+    vector<int> id(n);
+    for (int i = 0; i < n; i++) id[i] = i + 1;
+    shuffle(id.begin(), id.end(), rng);
+    shuffle(edges.begin(), edges.end(), rng);
+
+    vector<Edge> changes;
+    generateChanges(edges, num_changes, max_cost, changes);
+
+    mkdir(dir.c_str(), 0755);
+    if (!writeEdges(dir + "/topofile", edges, id) || !writeEdges(dir + "/changesfile", changes, id)) {
+        printf("Cannot write to %s\n", dir.c_str());
+        return -1;
+    }
+    FILE* fp = fopen((dir + "/messagefile").c_str(), "w");
+    if (fp == NULL) {
+        printf("Cannot write to %s\n", dir.c_str());
+        return -1;
+    }
+    for (int i = 0; i < num_messages; i++) {
+        fprintf(fp, "%d %d message %d from topogen\n", id[randInt(0, n - 1)], id[randInt(0, n - 1)], i);
+    }
+    fclose(fp);
+    printf("%s: %d nodes, %zu links, %d messages, %zu changes\n", shape, n, edges.size(), num_messages,
+           changes.size());
+    return 0;
+}